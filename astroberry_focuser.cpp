@@ -20,7 +20,6 @@
  * TO DO:
  * - Save position in xml instead flat file
  * - Add Thermal expansion ratio selection for various materials
- * - Add temperature compensation auto learning and save temperature compensation curve to xml
  * - Add simulation mode
  */
 
@@ -29,9 +28,15 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <fstream>
 #include <math.h>
 #include <memory>
+#include <chrono>
 #include "config.h"
 
 #include <gpiod.h>
@@ -41,14 +46,71 @@
 // We declare an auto pointer to AstroberryFocuser.
 std::unique_ptr<AstroberryFocuser> astroberryFocuser(new AstroberryFocuser());
 
-// create millisecond sleep macro
-#define msleep(milliseconds) usleep(milliseconds * 1000)
-
 #define MINMAX_MIN_POS 0 // lowest limit for focuser position
 #define MINMAX_MAX_POS 100000 // highest limit for focuser position
 #define MAX_RESOLUTION 32 // the highest resolution supported is 1/32 step
-#define TEMPERATURE_UPDATE_TIMEOUT (60 * 1000) // 60 sec
-#define TEMPERATURE_COMPENSATION_TIMEOUT (60 * 1000) // 60 sec
+#define MAX_RAMP_STEPS 100000 // the longest acceleration ramp
+#define TEMPERATURE_INVALID INT32_MIN // failed temperature sample
+#define TEMPERATURE_NO_SENSOR (INT32_MIN + 1) // no temperature sensor found
+#define HISTORY_RECORD_SIZE 16 // bytes of a temperature history record sent to clients
+#define W1_DEVICES "/sys/bus/w1/devices"
+#define TEMPERATURE_SAMPLE_RATIO 80 // sampling period in conversion times, 60 sec at 12 bit
+#define AUTOFOCUS_SETTLE_TIMEOUT (30 * 1000) // 30 sec without moves ends autofocus run
+#define AUTOFOCUS_MIN_MOVES 5 // moves needed to consider a run autofocus
+#define LEARNING_MIN_SAMPLES 3 // focus positions needed for learned model
+#define LEARNING_MIN_SPREAD 0.5 // standard deviation of temperature in °C needed for learned model
+#define TEMPERATURE_MIN_INTERVAL (5 * 1000) // 5 sec, shortest sampling interval set by compensation
+#define TEMPERATURE_MAX_INTERVAL (10 * 60 * 1000) // 10 min, longest sampling interval set by compensation
+#define POSITION_MAGIC 0x53505241 // "ARPS"
+#define POSITION_SLOT_SIZE 512 // each record in its own sector
+
+#define FLOATING -1 // mode line is left floating
+
+// Upper bounds of step latency histogram bins in microseconds, last bin is open ended
+static const uint32_t STEP_LATENCY_BINS[] = { 10, 20, 50, 100, 200, 500, 1000 };
+
+// Position store record, position at MAX_RESOLUTION
+struct PositionRecord
+{
+	uint32_t magic;
+	uint32_t sequence;
+	int32_t position;
+	uint32_t moving; // set by checkpoints taken while moving
+	uint32_t uncertainty; // how far focuser could move before the next checkpoint
+	uint32_t checksum;
+};
+
+/* Stepper motor resolution settings for ==== DRV8834 =====
+* 1) 1/1   - M1=0 M2=0
+* 2) 1/2   - M1=1 M2=0
+* 3) 1/4   - M1=floating M2=0
+* 4) 1/8   - M1=0 M2=1
+* 5) 1/16  - M1=1 M2=1
+* 6) 1/32  - M1=floating M2=1
+*/
+static constexpr struct { int resolution, m1, m2, m3; } DRV8834_MODES[] = {
+	{ 1, 0, 0, 0 },
+	{ 2, 1, 0, 0 },
+	{ 4, FLOATING, 0, 0 },
+	{ 8, 0, 1, 0 },
+	{ 16, 1, 1, 0 },
+	{ 32, FLOATING, 1, 0 },
+};
+
+/* Stepper motor resolution settings ===== for A4988 =====
+* 1) 1/1   - M1=0 M2=0 M3=0
+* 2) 1/2   - M1=1 M2=0 M3=0
+* 3) 1/4   - M1=0 M2=1 M3=0
+* 4) 1/8   - M1=1 M2=1 M3=0
+* 5) 1/16  - M1=1 M2=1 M3=1
+*/
+static constexpr struct { int resolution, m1, m2, m3; } A4988_MODES[] = {
+	{ 1, 0, 0, 0 },
+	{ 2, 1, 0, 0 },
+	{ 4, 0, 1, 0 },
+	{ 8, 1, 1, 0 },
+	{ 16, 1, 1, 1 },
+};
 
 void ISPoll(void *p);
 
@@ -122,10 +184,14 @@ AstroberryFocuser::AstroberryFocuser()
 		);
 
 	Focuser::setSupportedConnections(CONNECTION_NONE);
+
+	resetStepTiming();
 }
 
 AstroberryFocuser::~AstroberryFocuser()
 {
+	stopStepper();
+	stopTemperatureSampler();
 	deleteProperty(MotorBoardSP.name);
 	deleteProperty(BCMpinsNP.name);
 }
@@ -181,23 +247,50 @@ bool AstroberryFocuser::Connect()
 	gpio_m2 = gpiod_chip_get_line(chip, BCMpinsN[4].value);
 	gpio_m3 = gpiod_chip_get_line(chip, BCMpinsN[5].value);
 
-	// Set initial state for gpios
-	gpiod_line_request_output(gpio_dir, "dir@astroberry_focuser", 1); // default direction is outward
-	gpiod_line_request_output(gpio_step, "step@astroberry_focuser", 0);
-	gpiod_line_request_output(gpio_sleep, "sleep@astroberry_focuser", 1); // start stepper in wake up state
-	gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-	gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
+	// Group dir and mode lines in a single request, so they are written in one go
+	// DRV8834 M1 line stays out of the group as it needs to float for some resolutions
+	gpiod_line_bulk_init(&gpio_control);
+	gpiod_line_bulk_add(&gpio_control, gpio_dir);
+	gpiod_line_bulk_add(&gpio_control, gpio_m2);
 
 	// If A4988 controller, use additional GPIO
 	if ( MotorBoardS[1].s == ISS_ON )
-		gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 0);
+	{
+		gpiod_line_bulk_add(&gpio_control, gpio_m1);
+		gpiod_line_bulk_add(&gpio_control, gpio_m3);
+	}
 
-	//read last position from file & convert from MAX_RESOLUTION to current resolution
-	FocusAbsPosN[0].value = savePosition(-1) != -1 ? (int) savePosition(-1) * resolution / MAX_RESOLUTION : 0;
+	// Set initial state for gpios
+	controlValues[CONTROL_DIR] = 1; // default direction is outward
+	controlValues[CONTROL_M2] = 0;
+	controlValues[CONTROL_M1] = 0;
+	controlValues[CONTROL_M3] = 0;
+	m1Floating = false;
+	gpiod_line_request_bulk_output(&gpio_control, "control@astroberry_focuser", controlValues);
+	gpiod_line_request_output(gpio_step, "step@astroberry_focuser", 0);
+	gpiod_line_request_output(gpio_sleep, "sleep@astroberry_focuser", 1); // start stepper in wake up state
+	if ( MotorBoardS[0].s == ISS_ON )
+		gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
+
+	//read last position from position store & convert from MAX_RESOLUTION to current resolution
+	int position = 0;
+	openPositionStore(position);
+	FocusAbsPosN[0].value = position * resolution / MAX_RESOLUTION;
 
 	// preset resolution
 	setResolution(resolution);
 
+	// start stepping engine, driver comes out of reset at home position as SLEEP and RST are tied together
+	stepperPosition = (int) FocusAbsPosN[0].value * MAX_RESOLUTION / resolution;
+	stepperPhase = 0;
+	if (!startStepper())
+	{
+		DEBUG(INDI::Logger::DBG_ERROR, "Problem starting stepping engine.");
+		closePositionStore();
+		gpiod_chip_close(chip);
+		return false;
+	}
+
 	// Lock Motor Board setting
 	MotorBoardSP.s=IPS_BUSY;
 	IDSetSwitch(&MotorBoardSP, nullptr);
@@ -225,10 +318,15 @@ bool AstroberryFocuser::Connect()
 
 bool AstroberryFocuser::Disconnect()
 {
+	// Stop stepping engine
+	stopStepper();
+	closePositionStore();
+
 	// Stop timers
 	IERmTimer(stepperStandbyID);
-	IERmTimer(updateTemperatureID);
-	IERmTimer(temperatureCompensationID);
+
+	// Stop temperature sampler
+	stopTemperatureSampler();
 
 	// Set stepper motor asleep
 	gpiod_line_set_value(gpio_sleep, 0);
@@ -260,7 +358,8 @@ bool AstroberryFocuser::initProperties()
 	IUFillSwitch(&FocusResolutionS[3],"FOCUS_RESOLUTION_8","1/8 Step",ISS_OFF);
 	IUFillSwitch(&FocusResolutionS[4],"FOCUS_RESOLUTION_16","1/16 Step",ISS_OFF);
 	IUFillSwitch(&FocusResolutionS[5],"FOCUS_RESOLUTION_32","1/32 Step",ISS_OFF);
-	IUFillSwitchVector(&FocusResolutionSP,FocusResolutionS,6,getDeviceName(),"FOCUS_RESOLUTION","Resolution",MAIN_CONTROL_TAB,IP_RW,ISR_1OFMANY,0,IPS_IDLE);
+	IUFillSwitch(&FocusResolutionS[6],"FOCUS_RESOLUTION_AUTO","Auto",ISS_OFF);
+	IUFillSwitchVector(&FocusResolutionSP,FocusResolutionS,7,getDeviceName(),"FOCUS_RESOLUTION","Resolution",MAIN_CONTROL_TAB,IP_RW,ISR_1OFMANY,0,IPS_IDLE);
 
 	// Maximum focuser travel
 	IUFillNumber(&FocuserTravelN[0], "FOCUSER_TRAVEL_VALUE", "mm", "%0.0f", 10, 200, 10, 10);
@@ -272,6 +371,10 @@ bool AstroberryFocuser::initProperties()
 	IUFillNumber(&FocuserInfoN[2], "STEPS_PER_CFZ", "Steps / Critical Focus Zone", "%0.0f", 0, 1000, 1, 0);
 	IUFillNumberVector(&FocuserInfoNP, FocuserInfoN, 3, getDeviceName(), "FOCUSER_PARAMETERS", "Focuser Info", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
 
+	// Steps per critical focus zone for auto resolution
+	IUFillNumber(&AutoResolutionN[0], "AUTO_RESOLUTION_STEPS", "Steps / Critical Focus Zone", "%0.0f", 1, 100, 1, 4);
+	IUFillNumberVector(&AutoResolutionNP, AutoResolutionN, 1, getDeviceName(), "AUTO_RESOLUTION", "Auto Resolution", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
 	// Focuser Stepper Controller
 	IUFillSwitch(&MotorBoardS[0],"DRV8834","DRV8834",ISS_ON);
 	IUFillSwitch(&MotorBoardS[1],"A4988","A4988",ISS_OFF);
@@ -296,21 +399,131 @@ bool AstroberryFocuser::initProperties()
 	IUFillNumberVector(&StepperStandbyTimeNP, StepperStandbyTimeN, 1, getDeviceName(), "STEPPER_STANDBY_DELAY", "Standby Delay", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);	
 
 	// Step delay setting
-	IUFillNumber(&FocusStepDelayN[0], "FOCUS_STEPDELAY_VALUE", "milliseconds", "%0.0f", 1, 10, 1, 1);
+	IUFillNumber(&FocusStepDelayN[0], "FOCUS_STEPDELAY_VALUE", "microseconds", "%0.0f", 20, 20000, 100, 2000);
 	IUFillNumberVector(&FocusStepDelayNP, FocusStepDelayN, 1, getDeviceName(), "FOCUS_STEPDELAY", "Step Delay", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
 
+	// Motion profile setting, moves start at step delay rate and accelerate up to cruise speed
+	IUFillNumber(&MotionProfileN[0], "FOCUS_CRUISE_SPEED_VALUE", "Cruise Speed (steps/s)", "%0.0f", 1, 50000, 100, 500);
+	IUFillNumber(&MotionProfileN[1], "FOCUS_ACCELERATION_VALUE", "Acceleration (steps/s²)", "%0.0f", 0, 500000, 1000, 0);
+	IUFillNumberVector(&MotionProfileNP, MotionProfileN, 2, getDeviceName(), "FOCUS_MOTION_PROFILE", "Motion Profile", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// Position update rate while moving
+	IUFillNumber(&PositionUpdateRateN[0], "POSITION_UPDATE_RATE_VALUE", "Hz", "%0.0f", 1, 50, 1, 10);
+	IUFillNumberVector(&PositionUpdateRateNP, PositionUpdateRateN, 1, getDeviceName(), "POSITION_UPDATE_RATE", "Position Updates", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// Coarse stepping setting, the bulk of a move runs at coarse resolution and the final approach at focuser resolution
+	IUFillSwitch(&CoarseSteppingS[0],"COARSE_STEPPING_OFF","Disable",ISS_ON);
+	IUFillSwitch(&CoarseSteppingS[1],"COARSE_STEPPING_1","Full Step",ISS_OFF);
+	IUFillSwitch(&CoarseSteppingS[2],"COARSE_STEPPING_2","1/2 Step",ISS_OFF);
+	IUFillSwitch(&CoarseSteppingS[3],"COARSE_STEPPING_4","1/4 Step",ISS_OFF);
+	IUFillSwitch(&CoarseSteppingS[4],"COARSE_STEPPING_8","1/8 Step",ISS_OFF);
+	IUFillSwitchVector(&CoarseSteppingSP,CoarseSteppingS,5,getDeviceName(),"COARSE_STEPPING","Coarse Stepping",OPTIONS_TAB,IP_RW,ISR_1OFMANY,0,IPS_IDLE);
+
+	// Position checkpoint interval while moving
+	IUFillNumber(&PositionCheckpointN[0], "POSITION_CHECKPOINT_VALUE", "seconds", "%0.0f", 1, 60, 1, 5);
+	IUFillNumberVector(&PositionCheckpointNP, PositionCheckpointN, 1, getDeviceName(), "POSITION_CHECKPOINT", "Position Checkpoint", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// Step timing diagnostics
+	IUFillNumber(&StepTimingN[0], "STEP_LATENCY_10", "Steps late < 10 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[1], "STEP_LATENCY_20", "Steps late < 20 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[2], "STEP_LATENCY_50", "Steps late < 50 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[3], "STEP_LATENCY_100", "Steps late < 100 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[4], "STEP_LATENCY_200", "Steps late < 200 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[5], "STEP_LATENCY_500", "Steps late < 500 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[6], "STEP_LATENCY_1000", "Steps late < 1000 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[7], "STEP_LATENCY_MORE", "Steps late >= 1000 μs", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[8], "STEP_OVERRUNS", "Missed deadlines", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumber(&StepTimingN[9], "STEP_LATENCY_MAX", "Max latency (μs)", "%0.0f", 0, 4294967295.0, 0, 0);
+	IUFillNumberVector(&StepTimingNP, StepTimingN, 10, getDeviceName(), "STEP_TIMING", "Step Timing", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+	IUFillSwitch(&StepTimingResetS[0],"STEP_TIMING_RESET","Reset",ISS_OFF);
+	IUFillSwitchVector(&StepTimingResetSP,StepTimingResetS,1,getDeviceName(),"STEP_TIMING_RESET","Step Timing",OPTIONS_TAB,IP_RW,ISR_ATMOST1,0,IPS_IDLE);
+
+	// Final approach at focuser resolution
+	IUFillNumber(&FineApproachN[0], "FINE_APPROACH_VALUE", "full steps", "%0.0f", 0, 1000, 10, 10);
+	IUFillNumberVector(&FineApproachNP, FineApproachN, 1, getDeviceName(), "FINE_APPROACH", "Fine Approach", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
 	// Active telescope setting
 	IUFillText(&ActiveTelescopeT[0], "ACTIVE_TELESCOPE_NAME", "Telescope", "Telescope Simulator");
-	IUFillTextVector(&ActiveTelescopeTP, ActiveTelescopeT, 1, getDeviceName(), "ACTIVE_TELESCOPE", "Snoop devices", OPTIONS_TAB,IP_RW, 0, IPS_IDLE);
+	IUFillText(&ActiveTelescopeT[1], "ACTIVE_CCD_NAME", "CCD", "CCD Simulator");
+	IUFillTextVector(&ActiveTelescopeTP, ActiveTelescopeT, 2, getDeviceName(), "ACTIVE_TELESCOPE", "Snoop devices", OPTIONS_TAB,IP_RW, 0, IPS_IDLE);
 
 	// Focuser temperature
 	IUFillNumber(&FocusTemperatureN[0], "FOCUS_TEMPERATURE_VALUE", "°C", "%0.2f", -50, 50, 1, 0);
 	IUFillNumberVector(&FocusTemperatureNP, FocusTemperatureN, 1, getDeviceName(), "FOCUS_TEMPERATURE", "Temperature", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
 
+	// Temperature sensors
+	IUFillText(&TemperatureSensorsT[SENSOR_TUBE], "SENSOR_TUBE", "Tube", "");
+	IUFillText(&TemperatureSensorsT[SENSOR_AMBIENT], "SENSOR_AMBIENT", "Ambient", "");
+	IUFillText(&TemperatureSensorsT[SENSOR_MIRROR], "SENSOR_MIRROR", "Mirror", "");
+	IUFillTextVector(&TemperatureSensorsTP, TemperatureSensorsT, SENSOR_COUNT, getDeviceName(), "TEMPERATURE_SENSORS", "Temperature Sensors", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	IUFillNumber(&TemperatureSensorsN[SENSOR_TUBE], "SENSOR_TUBE", "Tube (°C)", "%0.2f", -50, 50, 1, 0);
+	IUFillNumber(&TemperatureSensorsN[SENSOR_AMBIENT], "SENSOR_AMBIENT", "Ambient (°C)", "%0.2f", -50, 50, 1, 0);
+	IUFillNumber(&TemperatureSensorsN[SENSOR_MIRROR], "SENSOR_MIRROR", "Mirror (°C)", "%0.2f", -50, 50, 1, 0);
+	IUFillNumberVector(&TemperatureSensorsNP, TemperatureSensorsN, SENSOR_COUNT, getDeviceName(), "TEMPERATURE_SENSOR_VALUES", "Sensors", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+	// Temperature sensors averaged for compensation
+	IUFillSwitch(&TemperatureSourceS[SENSOR_TUBE], "SENSOR_TUBE", "Tube", ISS_ON);
+	IUFillSwitch(&TemperatureSourceS[SENSOR_AMBIENT], "SENSOR_AMBIENT", "Ambient", ISS_OFF);
+	IUFillSwitch(&TemperatureSourceS[SENSOR_MIRROR], "SENSOR_MIRROR", "Mirror", ISS_OFF);
+	IUFillSwitchVector(&TemperatureSourceSP, TemperatureSourceS, SENSOR_COUNT, getDeviceName(), "TEMPERATURE_SOURCE", "Compensation Source", MAIN_CONTROL_TAB, IP_RW, ISR_NOFMANY, 0, IPS_IDLE);
+
+	// Temperature filter, compensation follows filtered temperature
+	IUFillNumber(&TemperatureFilterN[0], "FILTER_SAMPLES", "Smoothing (samples)", "%0.0f", 1, 100, 1, 5);
+	IUFillNumber(&TemperatureFilterN[1], "FILTER_CFZ_FRACTION", "Threshold (CFZ)", "%0.2f", 0.1, 2, 0.05, 0.5);
+	IUFillNumberVector(&TemperatureFilterNP, TemperatureFilterN, 2, getDeviceName(), "TEMPERATURE_FILTER", "Compensation Filter", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// Compensation moves wait for end of exposure up to deadline
+	IUFillNumber(&CompensationDeadlineN[0], "COMPENSATION_DEADLINE_VALUE", "seconds", "%0.0f", 0, 3600, 60, 300);
+	IUFillNumberVector(&CompensationDeadlineNP, CompensationDeadlineN, 1, getDeviceName(), "COMPENSATION_DEADLINE", "Exposure Deferral", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// Temperature history, sent on request
+	IUFillSwitch(&TemperatureHistoryS[0], "HISTORY_FETCH", "Fetch", ISS_OFF);
+	IUFillSwitchVector(&TemperatureHistorySP, TemperatureHistoryS, 1, getDeviceName(), "TEMPERATURE_HISTORY_FETCH", "Temperature History", OPTIONS_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+	IUFillBLOB(&TemperatureHistoryB[0], "TEMPERATURE_HISTORY_DATA", "History", ".bin");
+	IUFillBLOBVector(&TemperatureHistoryBP, TemperatureHistoryB, 1, getDeviceName(), "TEMPERATURE_HISTORY", "Temperature History", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+	IUFillNumber(&FilteredTemperatureN[0], "FILTERED_TEMPERATURE_VALUE", "°C", "%0.2f", -50, 50, 1, 0);
+	IUFillNumberVector(&FilteredTemperatureNP, FilteredTemperatureN, 1, getDeviceName(), "FILTERED_TEMPERATURE", "Filtered Temperature", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
+	// Temperature compensation model, learned model is fitted to recorded focus positions
+	IUFillSwitch(&TemperatureModelS[0], "MODEL_COEFFICIENT", "Coefficient", ISS_ON);
+	IUFillSwitch(&TemperatureModelS[1], "MODEL_LEARNED", "Learned", ISS_OFF);
+	IUFillSwitchVector(&TemperatureModelSP, TemperatureModelS, 2, getDeviceName(), "TEMPERATURE_MODEL", "Compensation Model", MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+	IUFillSwitch(&FocusLearningS[0], "FOCUS_RECORD", "Record Focus", ISS_OFF);
+	IUFillSwitch(&FocusLearningS[1], "LEARNING_RESET", "Reset", ISS_OFF);
+	IUFillSwitchVector(&FocusLearningSP, FocusLearningS, 2, getDeviceName(), "FOCUS_LEARNING", "Learning", MAIN_CONTROL_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+
+	// autofocus is detected from client moves, manual jogging would be recorded too
+	IUFillSwitch(&AutoRecordS[0], "AUTO_RECORD_ON", "Enable", ISS_OFF);
+	IUFillSwitch(&AutoRecordS[1], "AUTO_RECORD_OFF", "Disable", ISS_ON);
+	IUFillSwitchVector(&AutoRecordSP, AutoRecordS, 2, getDeviceName(), "FOCUS_AUTO_RECORD", "Record Autofocus", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
+	// Running sums of least squares fit of position at MAX_RESOLUTION to temperature, kept in config, cleared by reset
+	IUFillNumber(&LearningDataN[0], "LEARNING_N", "Samples", "%.0f", 0, 1e9, 0, 0);
+	IUFillNumber(&LearningDataN[1], "LEARNING_T", "Sum T", "%.6g", -1e18, 1e18, 0, 0);
+	IUFillNumber(&LearningDataN[2], "LEARNING_P", "Sum P", "%.6g", -1e18, 1e18, 0, 0);
+	IUFillNumber(&LearningDataN[3], "LEARNING_TT", "Sum TT", "%.6g", -1e18, 1e18, 0, 0);
+	IUFillNumber(&LearningDataN[4], "LEARNING_TP", "Sum TP", "%.6g", -1e18, 1e18, 0, 0);
+	IUFillNumberVector(&LearningDataNP, LearningDataN, 5, getDeviceName(), "TEMPERATURE_LEARNING", "Learning Data", OPTIONS_TAB, IP_RO, 0, IPS_IDLE);
+
+	IUFillNumber(&LearnedModelN[0], "LEARNED_SLOPE", "Steps/°C", "%0.1f", -1e6, 1e6, 0, 0);
+	IUFillNumber(&LearnedModelN[1], "LEARNED_SAMPLES", "Samples", "%0.0f", 0, 1e9, 0, 0);
+	IUFillNumberVector(&LearnedModelNP, LearnedModelN, 2, getDeviceName(), "LEARNED_MODEL", "Learned Model", MAIN_CONTROL_TAB, IP_RO, 0, IPS_IDLE);
+
 	// Temperature Coefficient
 	IUFillNumber(&TemperatureCoefN[0], "μm/m°C", "", "%.1f", 0, 50, 1, 0);
 	IUFillNumberVector(&TemperatureCoefNP, TemperatureCoefN, 1, getDeviceName(), "Temperature Coefficient", "", MAIN_CONTROL_TAB, IP_RW, 0, IPS_IDLE);
 
+	// Temperature sensor resolution, lower resolution converts faster
+	IUFillSwitch(&TemperatureResolutionS[0], "TEMPERATURE_RESOLUTION_9", "9 bit (0.5°C)", ISS_OFF);
+	IUFillSwitch(&TemperatureResolutionS[1], "TEMPERATURE_RESOLUTION_10", "10 bit (0.25°C)", ISS_OFF);
+	IUFillSwitch(&TemperatureResolutionS[2], "TEMPERATURE_RESOLUTION_11", "11 bit (0.125°C)", ISS_OFF);
+	IUFillSwitch(&TemperatureResolutionS[3], "TEMPERATURE_RESOLUTION_12", "12 bit (0.0625°C)", ISS_ON);
+	IUFillSwitchVector(&TemperatureResolutionSP, TemperatureResolutionS, 4, getDeviceName(), "FOCUS_TEMPERATURE_RESOLUTION", "Sensor Resolution", OPTIONS_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+
 	// Compensate for temperature
 	IUFillSwitch(&TemperatureCompensateS[0], "Enable", "", ISS_OFF);
 	IUFillSwitch(&TemperatureCompensateS[1], "Disable", "", ISS_ON);
@@ -382,22 +595,24 @@ bool AstroberryFocuser::updateProperties()
 		defineSwitch(&FocusResolutionSP);
 		defineNumber(&FocuserTravelNP);
 		defineNumber(&FocuserInfoNP);
+		defineNumber(&AutoResolutionNP);
 		defineNumber(&FocusStepDelayNP);
+		defineNumber(&MotionProfileNP);
+		defineNumber(&PositionUpdateRateNP);
+		defineSwitch(&CoarseSteppingSP);
+		defineNumber(&FineApproachNP);
+		defineNumber(&PositionCheckpointNP);
+		updateStepTiming();
+		defineNumber(&StepTimingNP);
+		defineSwitch(&StepTimingResetSP);
 
 		IDSnoopDevice(ActiveTelescopeT[0].text, "TELESCOPE_INFO");
+		IDSnoopDevice(ActiveTelescopeT[1].text, "CCD_EXPOSURE");
+		autoResolution();
 
-		if (readDS18B20())
-		{
-			defineNumber(&FocusTemperatureNP);
-			defineNumber(&TemperatureCoefNP);
-			defineSwitch(&TemperatureCompensateSP);
-			readDS18B20(); // update immediately
-			lastTemperature = FocusTemperatureN[0].value; // init last temperature
-			IERmTimer(updateTemperatureID);
-			updateTemperatureID = IEAddTimer(TEMPERATURE_UPDATE_TIMEOUT, updateTemperatureHelper, this); // set temperature update timer
-			IERmTimer(temperatureCompensationID);
-			temperatureCompensationID = IEAddTimer(TEMPERATURE_COMPENSATION_TIMEOUT, temperatureCompensationHelper, this); // set temperature compensation timer
-		}
+		// temperature properties are defined when sensor is found
+		defineText(&TemperatureSensorsTP);
+		startTemperatureSampler();
 
 	} else {
 		deleteProperty(StepperStandbySP.name);
@@ -406,10 +621,40 @@ bool AstroberryFocuser::updateProperties()
 		deleteProperty(FocusResolutionSP.name);
 		deleteProperty(FocuserTravelNP.name);
 		deleteProperty(FocuserInfoNP.name);
+		deleteProperty(AutoResolutionNP.name);
 		deleteProperty(FocusStepDelayNP.name);
+		deleteProperty(MotionProfileNP.name);
+		deleteProperty(PositionUpdateRateNP.name);
+		deleteProperty(CoarseSteppingSP.name);
+		deleteProperty(FineApproachNP.name);
+		deleteProperty(PositionCheckpointNP.name);
+		deleteProperty(StepTimingNP.name);
+		deleteProperty(StepTimingResetSP.name);
+		stopTemperatureSampler();
+		deleteProperty(TemperatureSensorsTP.name);
+		deleteProperty(TemperatureSensorsNP.name);
+		deleteProperty(TemperatureSourceSP.name);
 		deleteProperty(FocusTemperatureNP.name);
+		deleteProperty(FilteredTemperatureNP.name);
+		deleteProperty(TemperatureModelSP.name);
+		deleteProperty(FocusLearningSP.name);
+		deleteProperty(AutoRecordSP.name);
+		deleteProperty(LearningDataNP.name);
+		deleteProperty(LearnedModelNP.name);
+		IERmTimer(autofocusSettledID);
+		autofocusSettledID = -1;
+		deleteProperty(TemperatureFilterNP.name);
+		deleteProperty(CompensationDeadlineNP.name);
+		deleteProperty(TemperatureHistorySP.name);
+		deleteProperty(TemperatureHistoryBP.name);
+		IERmTimer(compensationDeadlineID);
+		compensationDeadlineID = -1;
+		compensationDeferred = false;
+		compensationOverdue = false;
+		exposureActive = false;
 		deleteProperty(TemperatureCoefNP.name);
 		deleteProperty(TemperatureCompensateSP.name);
+		deleteProperty(TemperatureResolutionSP.name);
 	}
 
 	return true;
@@ -507,19 +752,116 @@ bool AstroberryFocuser::ISNewNumber (const char *dev, const char *name, double v
 			FocuserTravelNP.s=IPS_OK;
 			IDSetNumber(&FocuserTravelNP, nullptr);
 			getFocuserInfo();
+			autoResolution();
 			DEBUGF(INDI::Logger::DBG_SESSION, "Maximum focuser travel set to %0.0f mm", FocuserTravelN[0].value);
 			return true;
 		}
 
+		// handle auto resolution
+		if (!strcmp(name, AutoResolutionNP.name))
+		{
+			IUUpdateNumber(&AutoResolutionNP,values,names,n);
+			AutoResolutionNP.s=IPS_OK;
+			IDSetNumber(&AutoResolutionNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Auto resolution set to %0.0f steps per critical focus zone.", AutoResolutionN[0].value);
+			autoResolution();
+			return true;
+		}
+
 		// handle focus step delay
 		if (!strcmp(name, FocusStepDelayNP.name))
 		{
+			// convert step delay saved in milliseconds by older versions
+			if (values[0] <= 10)
+				values[0] *= 2000;
+
 			IUUpdateNumber(&FocusStepDelayNP,values,names,n);
 			FocusStepDelayNP.s=IPS_BUSY;
 			IDSetNumber(&FocusStepDelayNP, nullptr);
 			FocusStepDelayNP.s=IPS_OK;
 			IDSetNumber(&FocusStepDelayNP, nullptr);
-			DEBUGF(INDI::Logger::DBG_SESSION, "Step delay set to %0.0f ms.", FocusStepDelayN[0].value);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Step delay set to %0.0f μs.", FocusStepDelayN[0].value);
+			return true;
+		}
+
+		// handle motion profile
+		if (!strcmp(name, MotionProfileNP.name))
+		{
+			IUUpdateNumber(&MotionProfileNP,values,names,n);
+			MotionProfileNP.s=IPS_OK;
+			IDSetNumber(&MotionProfileNP, nullptr);
+			if (MotionProfileN[1].value > 0)
+			{
+				DEBUGF(INDI::Logger::DBG_SESSION, "Motion profile set to cruise speed %0.0f steps/s and acceleration %0.0f steps/s².", MotionProfileN[0].value, MotionProfileN[1].value);
+			} else {
+				DEBUG(INDI::Logger::DBG_SESSION, "Motion profile disabled. Focuser moves at step delay rate.");
+			}
+			return true;
+		}
+
+		// handle position update rate
+		if (!strcmp(name, PositionUpdateRateNP.name))
+		{
+			IUUpdateNumber(&PositionUpdateRateNP,values,names,n);
+			PositionUpdateRateNP.s=IPS_OK;
+			IDSetNumber(&PositionUpdateRateNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Position updates set to %0.0f Hz.", PositionUpdateRateN[0].value);
+			return true;
+		}
+
+		// handle position checkpoint interval
+		if (!strcmp(name, PositionCheckpointNP.name))
+		{
+			IUUpdateNumber(&PositionCheckpointNP,values,names,n);
+			PositionCheckpointNP.s=IPS_OK;
+			IDSetNumber(&PositionCheckpointNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Position checkpoint set to every %0.0f seconds while moving.", PositionCheckpointN[0].value);
+			return true;
+		}
+
+		// handle fine approach
+		if (!strcmp(name, FineApproachNP.name))
+		{
+			IUUpdateNumber(&FineApproachNP,values,names,n);
+			FineApproachNP.s=IPS_OK;
+			IDSetNumber(&FineApproachNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Fine approach set to %0.0f full steps.", FineApproachN[0].value);
+			return true;
+		}
+
+		// handle learning data, accepted from config only
+		if (!strcmp(name, LearningDataNP.name))
+		{
+			if (!learningDataLoading)
+			{
+				IDSetNumber(&LearningDataNP, nullptr);
+				return false;
+			}
+			IUUpdateNumber(&LearningDataNP,values,names,n);
+			LearningDataNP.s=IPS_OK;
+			IDSetNumber(&LearningDataNP, nullptr);
+			updateLearnedModel();
+			IDSetNumber(&LearnedModelNP, nullptr);
+			return true;
+		}
+
+		// handle temperature filter
+		if (!strcmp(name, TemperatureFilterNP.name))
+		{
+			IUUpdateNumber(&TemperatureFilterNP,values,names,n);
+			TemperatureFilterNP.s=IPS_OK;
+			IDSetNumber(&TemperatureFilterNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Temperature filter set to %0.0f samples, compensation threshold to %0.2f CFZ.", TemperatureFilterN[0].value, TemperatureFilterN[1].value);
+			return true;
+		}
+
+		// handle exposure deferral
+		if (!strcmp(name, CompensationDeadlineNP.name))
+		{
+			IUUpdateNumber(&CompensationDeadlineNP,values,names,n);
+			CompensationDeadlineNP.s=IPS_OK;
+			IDSetNumber(&CompensationDeadlineNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Compensation moves deferred during exposure for up to %0.0f seconds.", CompensationDeadlineN[0].value);
 			return true;
 		}
 
@@ -569,6 +911,7 @@ bool AstroberryFocuser::ISNewSwitch (const char *dev, const char *name, ISState
 
 				MotorBoardSP.s = IPS_OK;
 				IDSetSwitch(&MotorBoardSP, nullptr);
+				autoResolution(); // resolution range depends on board, otherwise picked on connect
 				return true;
 			}
 		}
@@ -594,106 +937,169 @@ bool AstroberryFocuser::ISNewSwitch (const char *dev, const char *name, ISState
 			return true;
 		}
 
+		// handle step timing reset
+		if(!strcmp(name, StepTimingResetSP.name))
+		{
+			resetStepTiming();
+			updateStepTiming();
+			IDSetNumber(&StepTimingNP, nullptr);
+			StepTimingResetS[0].s = ISS_OFF;
+			StepTimingResetSP.s = IPS_OK;
+			IDSetSwitch(&StepTimingResetSP, nullptr);
+			DEBUG(INDI::Logger::DBG_SESSION, "Step timing statistics reset.");
+			return true;
+		}
+
+		// handle coarse stepping
+		if(!strcmp(name, CoarseSteppingSP.name))
+		{
+			IUUpdateSwitch(&CoarseSteppingSP, states, names, n);
+			CoarseSteppingSP.s = IPS_OK;
+			IDSetSwitch(&CoarseSteppingSP, nullptr);
+
+			if ( CoarseSteppingS[0].s == ISS_ON)
+			{
+				DEBUG(INDI::Logger::DBG_SESSION, "Coarse stepping disabled.");
+			} else {
+				DEBUGF(INDI::Logger::DBG_SESSION, "Coarse stepping set to %s.", CoarseSteppingS[IUFindOnSwitchIndex(&CoarseSteppingSP)].label);
+			}
+			return true;
+		}
+
 		// handle focus resolution
 		if(!strcmp(name, FocusResolutionSP.name))
 		{
-			int last_resolution = resolution;
 			int current_switch = IUFindOnSwitchIndex(&FocusResolutionSP);
 
 			IUUpdateSwitch(&FocusResolutionSP, states, names, n);
 
-			//Resolution 1/1
-			if ( FocusResolutionS[0].s == ISS_ON )
-				resolution = 1;
+			// Resolution picked from critical focus zone
+			if ( FocusResolutionS[6].s == ISS_ON )
+			{
+				FocusResolutionSP.s = IPS_OK;
+				DEBUG(INDI::Logger::DBG_SESSION, "Focuser resolution set to auto.");
+				autoResolution();
+				IDSetSwitch(&FocusResolutionSP, nullptr);
+				return true;
+			}
+
+			// Resolution 1/1 to 1/32
+			int new_resolution = 1 << IUFindOnSwitchIndex(&FocusResolutionSP);
 
-			//Resolution 1/2
-			if ( FocusResolutionS[1].s == ISS_ON )
-				resolution = 2;
+			if ( new_resolution == 32 && MotorBoardS[1].s == ISS_ON )
+			{
+				// reset switch to previous state if resolution is invalid
+				IUResetSwitch(&FocusResolutionSP);
+				FocusResolutionS[current_switch].s = ISS_ON;
+				IDSetSwitch(&FocusResolutionSP, nullptr);
 
-			//Resolution 1/4
-			if ( FocusResolutionS[2].s == ISS_ON )
-				resolution = 4;
+				DEBUG(INDI::Logger::DBG_WARNING, "A4988 Control Board does not support this resolution.");
+				return false;
+			}
 
-			//Resolution 1/8
-			if ( FocusResolutionS[3].s == ISS_ON )
-				resolution = 8;
+			changeResolution(new_resolution);
+			IDSetSwitch(&FocusResolutionSP, nullptr);
+			return true;
+		}
 
-			//Resolution 1/16
-			if ( FocusResolutionS[4].s == ISS_ON )
-				resolution = 16;
+		// handle temperature sensor resolution
+		if(!strcmp(name, TemperatureResolutionSP.name))
+		{
+			IUUpdateSwitch(&TemperatureResolutionSP, states, names, n);
+			temperatureResolution = 9 + IUFindOnSwitchIndex(&TemperatureResolutionSP);
 
-			//Resolution 1/32
-			if ( FocusResolutionS[5].s == ISS_ON )
+			// sampler applies resolution before next sample
 			{
-				if ( MotorBoardS[1].s == ISS_ON )
-				{
-					// reset switch to previous state if resolution is invalid
-					FocusResolutionS[current_switch].s = ISS_ON;
-					IDSetSwitch(&FocusResolutionSP, nullptr);
-
-					DEBUG(INDI::Logger::DBG_WARNING, "A4988 Control Board does not support this resolution.");
-					return false;
-				}
-				resolution = 32;
+				std::lock_guard<std::mutex> lock(temperatureMutex);
+				temperatureConfigChanged = true;
 			}
+			temperatureCondition.notify_all();
+
+			TemperatureResolutionSP.s = IPS_BUSY;
+			IDSetSwitch(&TemperatureResolutionSP, nullptr);
+			return true;
+		}
+
+		// handle temperature compensation model
+		if(!strcmp(name, TemperatureModelSP.name))
+		{
+			IUUpdateSwitch(&TemperatureModelSP, states, names, n);
+			TemperatureModelSP.s = IPS_OK;
+			IDSetSwitch(&TemperatureModelSP, nullptr);
+
+			double slope;
+			if (TemperatureModelS[1].s == ISS_ON && !learnedSlope(slope))
+				DEBUG(INDI::Logger::DBG_WARNING, "Not enough focus positions recorded for learned model. Using temperature coefficient until then.");
+			DEBUGF(INDI::Logger::DBG_SESSION, "Temperature compensation model set to %s.", TemperatureModelS[0].s == ISS_ON ? "coefficient" : "learned");
+			return true;
+		}
 
-			// Adjust position to a step in lower resolution
-			int position_adjustment = last_resolution * (FocusAbsPosN[0].value / last_resolution - (int) FocusAbsPosN[0].value / last_resolution);
-			if ( resolution < last_resolution && position_adjustment > 0 )
+		// handle focus learning
+		if(!strcmp(name, FocusLearningSP.name))
+		{
+			IUUpdateSwitch(&FocusLearningSP, states, names, n);
+
+			if (FocusLearningS[0].s == ISS_ON)
+				recordFocus();
+
+			if (FocusLearningS[1].s == ISS_ON)
 			{
-				if ( (float) position_adjustment / last_resolution < 0.5)
-				{
-					position_adjustment *= -1;
-				} else {
-					position_adjustment = last_resolution - position_adjustment;
-				}
-				DEBUGF(INDI::Logger::DBG_SESSION, "Focuser position adjusted by %d steps at 1/%d resolution to sync with 1/%d resolution.", position_adjustment, last_resolution, resolution);
-				MoveAbsFocuser(FocusAbsPosN[0].value + position_adjustment);
+				for (auto &sum : LearningDataN)
+					sum.value = 0;
+				IDSetNumber(&LearningDataNP, nullptr);
+				updateLearnedModel();
+				IDSetNumber(&LearnedModelNP, nullptr);
+				saveConfig(true, LearningDataNP.name);
+				DEBUG(INDI::Logger::DBG_SESSION, "Learned temperature model reset.");
 			}
 
-			setResolution(resolution);
-
-			// update values based on resolution
-			FocusMaxPosN[0].max = (int) FocusMaxPosN[0].max * resolution / last_resolution;
-			FocusMaxPosN[0].step = (int) FocusMaxPosN[0].step * resolution / last_resolution;
-			FocusMaxPosN[0].value = (int) FocusMaxPosN[0].value * resolution / last_resolution;
-			IDSetNumber(&FocusMaxPosNP, nullptr);
-			IUUpdateMinMax(&FocusMaxPosNP); // This call is not INDI protocol compliant
-
-			FocusAbsPosN[0].max = (int) FocusAbsPosN[0].max * resolution / last_resolution;
-			FocusAbsPosN[0].step = (int) FocusAbsPosN[0].step * resolution / last_resolution;
-			FocusAbsPosN[0].value = (int) FocusAbsPosN[0].value * resolution / last_resolution;
-			IDSetNumber(&FocusAbsPosNP, nullptr);
-			IUUpdateMinMax(&FocusAbsPosNP); // This call is not INDI protocol compliant
-
-			FocusRelPosN[0].max = (int) FocusRelPosN[0].max * resolution / last_resolution;
-			FocusRelPosN[0].step = (int) FocusRelPosN[0].step * resolution / last_resolution;
-			FocusRelPosN[0].value = (int) FocusRelPosN[0].value * resolution / last_resolution;
-			IDSetNumber(&FocusRelPosNP, nullptr);
-			IUUpdateMinMax(&FocusRelPosNP); // This call is not INDI protocol compliant
-
-			FocusSyncN[0].max = FocusSyncN[0].max * resolution / last_resolution;
-			FocusSyncN[0].step = FocusSyncN[0].step * resolution / last_resolution;
-			FocusSyncN[0].value = FocusSyncN[0].value * resolution / last_resolution;
-			IDSetNumber(&FocusSyncNP, nullptr);
-			IUUpdateMinMax(&FocusSyncNP); // This call is not INDI protocol compliant
-
-			FocusBacklashN[0].max = (int) FocusBacklashN[0].max * resolution / last_resolution;
-			FocusBacklashN[0].step = (int) FocusBacklashN[0].step * resolution / last_resolution;
-			FocusBacklashN[0].value = (int) FocusBacklashN[0].value * resolution / last_resolution;
-			IDSetNumber(&FocusBacklashNP, nullptr);
-			IUUpdateMinMax(&FocusBacklashNP); // This call is not INDI protocol compliant
-
-			PresetN[0].value = (int) PresetN[0].value * resolution / last_resolution;
-			PresetN[1].value = (int) PresetN[1].value * resolution / last_resolution;
-			PresetN[2].value = (int) PresetN[2].value * resolution / last_resolution;
-			IDSetNumber(&PresetNP, nullptr);
+			IUResetSwitch(&FocusLearningSP);
+			FocusLearningSP.s = IPS_OK;
+			IDSetSwitch(&FocusLearningSP, nullptr);
+			return true;
+		}
 
-			getFocuserInfo();
+		// handle temperature history
+		if(!strcmp(name, TemperatureHistorySP.name))
+		{
+			sendHistory();
+			IUResetSwitch(&TemperatureHistorySP);
+			TemperatureHistorySP.s = IPS_OK;
+			IDSetSwitch(&TemperatureHistorySP, nullptr);
+			return true;
+		}
 
-			FocusResolutionSP.s = IPS_OK;
-			IDSetSwitch(&FocusResolutionSP, nullptr);
-			DEBUGF(INDI::Logger::DBG_SESSION, "Focuser resolution set to 1/%d.", resolution);
+		// handle autofocus recording
+		if(!strcmp(name, AutoRecordSP.name))
+		{
+			IUUpdateSwitch(&AutoRecordSP, states, names, n);
+			AutoRecordSP.s = IPS_OK;
+			IDSetSwitch(&AutoRecordSP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Recording of autofocus results %s.", AutoRecordS[0].s == ISS_ON ? "enabled" : "disabled");
+			return true;
+		}
+
+		// handle temperature compensation source
+		if(!strcmp(name, TemperatureSourceSP.name))
+		{
+			IUUpdateSwitch(&TemperatureSourceSP, states, names, n);
+
+			std::string sources;
+			for (int i = 0; i < SENSOR_COUNT; i++)
+				if (TemperatureSourceS[i].s == ISS_ON)
+					sources += (sources.empty() ? "" : ", ") + std::string(TemperatureSourceS[i].label);
+
+			if (sources.empty())
+			{
+				TemperatureSourceSP.s = IPS_ALERT;
+				IDSetSwitch(&TemperatureSourceSP, nullptr);
+				DEBUG(INDI::Logger::DBG_WARNING, "No temperature sensor selected for compensation.");
+				return true;
+			}
+
+			TemperatureSourceSP.s = IPS_OK;
+			IDSetSwitch(&TemperatureSourceSP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Temperature compensation follows %s.", sources.c_str());
 			return true;
 		}
 
@@ -704,19 +1110,19 @@ bool AstroberryFocuser::ISNewSwitch (const char *dev, const char *name, ISState
 
 			if ( TemperatureCompensateS[0].s == ISS_ON)
 			{
-				if (!temperatureCompensationID)
-					temperatureCompensationID = IEAddTimer(TEMPERATURE_COMPENSATION_TIMEOUT, temperatureCompensationHelper, this);
 				TemperatureCompensateSP.s = IPS_OK;
 				DEBUG(INDI::Logger::DBG_SESSION, "Temperature compensation enabled.");
 			}
 
 			if ( TemperatureCompensateS[1].s == ISS_ON)
 			{
-				IERmTimer(temperatureCompensationID);
 				TemperatureCompensateSP.s = IPS_IDLE;
 				DEBUG(INDI::Logger::DBG_SESSION, "Temperature compensation disabled.");
 			}
 
+			// compensation sets sampling schedule
+			temperatureCompensation();
+
 			IDSetSwitch(&TemperatureCompensateSP, nullptr);
 			return true;
 		}
@@ -737,10 +1143,24 @@ bool AstroberryFocuser::ISNewText (const char *dev, const char *name, char *text
 
 			IUFillNumberVector(&ScopeParametersNP, ScopeParametersN, 2, ActiveTelescopeT[0].text, "TELESCOPE_INFO", "Scope Properties", OPTIONS_TAB, IP_RW, 60, IPS_OK);
 			IDSnoopDevice(ActiveTelescopeT[0].text, "TELESCOPE_INFO");
+			IDSnoopDevice(ActiveTelescopeT[1].text, "CCD_EXPOSURE");
+			exposureEvent(false);
 
 			ActiveTelescopeTP.s=IPS_OK;
 			IDSetText(&ActiveTelescopeTP, nullptr);
-			DEBUGF(INDI::Logger::DBG_SESSION, "Active telescope set to %s.", ActiveTelescopeT[0].text);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Active telescope set to %s, active CCD set to %s.", ActiveTelescopeT[0].text, ActiveTelescopeT[1].text);
+			return true;
+		}
+
+		// handle temperature sensors
+		if (!strcmp(name, TemperatureSensorsTP.name))
+		{
+			IUUpdateText(&TemperatureSensorsTP,texts,names,n);
+			TemperatureSensorsTP.s=IPS_OK;
+			IDSetText(&TemperatureSensorsTP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Temperature sensors set to Tube: %s, Ambient: %s, Mirror: %s.", TemperatureSensorsT[SENSOR_TUBE].text, TemperatureSensorsT[SENSOR_AMBIENT].text, TemperatureSensorsT[SENSOR_MIRROR].text);
+			if (temperatureThread.joinable())
+				findDS18B20();
 			return true;
 		}
 	}
@@ -753,10 +1173,22 @@ bool AstroberryFocuser::ISSnoopDevice (XMLEle *root)
 	if (IUSnoopNumber(root, &ScopeParametersNP) == 0)
 	{
 		getFocuserInfo();
+		autoResolution();
 		DEBUGF(INDI::Logger::DBG_DEBUG, "Telescope parameters: %0.0f, %0.0f.", ScopeParametersN[0].value, ScopeParametersN[1].value);
 		return true;
 	}
 
+	// camera is exposing while its exposure property is busy
+	const char *propName = findXMLAttValu(root, "name");
+	const char *deviceName = findXMLAttValu(root, "device");
+	if (!strcmp(propName, "CCD_EXPOSURE") && !strcmp(deviceName, ActiveTelescopeT[1].text))
+	{
+		IPState state;
+		if (crackIPState(findXMLAttValu(root, "state"), &state) == 0)
+			exposureEvent(state == IPS_BUSY);
+		return true;
+	}
+
 	return INDI::Focuser::ISSnoopDevice(root);
 }
 
@@ -767,87 +1199,33 @@ bool AstroberryFocuser::saveConfigItems(FILE *fp)
 	IUSaveConfigSwitch(fp, &StepperStandbySP);
 	IUSaveConfigNumber(fp, &StepperStandbyTimeNP);
 	IUSaveConfigSwitch(fp, &FocusResolutionSP);
+	IUSaveConfigNumber(fp, &AutoResolutionNP);
 	IUSaveConfigSwitch(fp, &FocusReverseSP);
 	IUSaveConfigNumber(fp, &FocusMaxPosNP);
 	IUSaveConfigSwitch(fp, &FocusBacklashSP);
 	IUSaveConfigNumber(fp, &FocusBacklashNP);
 	IUSaveConfigNumber(fp, &FocusStepDelayNP);
+	IUSaveConfigNumber(fp, &MotionProfileNP);
+	IUSaveConfigNumber(fp, &PositionUpdateRateNP);
+	IUSaveConfigSwitch(fp, &CoarseSteppingSP);
+	IUSaveConfigNumber(fp, &FineApproachNP);
+	IUSaveConfigNumber(fp, &PositionCheckpointNP);
 	IUSaveConfigNumber(fp, &FocuserTravelNP);
 	IUSaveConfigSwitch(fp, &TemperatureCompensateSP);
 	IUSaveConfigNumber(fp, &TemperatureCoefNP);
+	IUSaveConfigSwitch(fp, &TemperatureResolutionSP);
+	IUSaveConfigText(fp, &TemperatureSensorsTP);
+	IUSaveConfigSwitch(fp, &TemperatureSourceSP);
+	IUSaveConfigNumber(fp, &TemperatureFilterNP);
+	IUSaveConfigNumber(fp, &CompensationDeadlineNP);
+	IUSaveConfigSwitch(fp, &TemperatureModelSP);
+	IUSaveConfigSwitch(fp, &AutoRecordSP);
+	IUSaveConfigNumber(fp, &LearningDataNP);
 	IUSaveConfigText(fp, &ActiveTelescopeTP);
 	IUSaveConfigNumber(fp, &PresetNP);
 	return true;
 }
 
-void AstroberryFocuser::TimerHit()
-{
-	if (backlashTicksRemaining == 0 && focuserTicksRemaining == 0)
-	{
-		//save position to file
-		savePosition((int) FocusAbsPosN[0].value * MAX_RESOLUTION / resolution); // always save at MAX_RESOLUTION
-
-		// update abspos value and status
-		FocusAbsPosNP.s = IPS_OK;
-		IDSetNumber(&FocusAbsPosNP, nullptr);
-		FocusRelPosNP.s = IPS_OK;
-		IDSetNumber(&FocusRelPosNP, nullptr);
-		DEBUGF(INDI::Logger::DBG_SESSION, "Focuser at the position %0.0f.", FocusAbsPosN[0].value);
-
-		// reset last temperature
-		lastTemperature = FocusTemperatureN[0].value; // register last temperature
-
-		// set motor standby timer
-		if ( StepperStandbyS[0].s == ISS_ON)
-		{
-			if (stepperStandbyID)
-				IERmTimer(stepperStandbyID);
-			stepperStandbyID = IEAddTimer(StepperStandbyTimeN[0].value * 1000, stepperStandbyHelper, this);
-			DEBUGF(INDI::Logger::DBG_SESSION, "Focuser going standby in %d seconds", (int) IERemainingTimer(stepperStandbyID) /  1000);
-		}
-		return;
-	}
-
-	// handle reverse motion
-	if (stepperDirection == 1)
-	{
-		// outward
-		if (FocusReverseS[INDI_ENABLED].s == ISS_ON) {
-			gpiod_line_set_value(gpio_dir, 0); // Reverse Motion
-		} else {
-			gpiod_line_set_value(gpio_dir, 1); // Normal Motion
-		}
-	} else {
-		// inward
-		if (FocusReverseS[INDI_ENABLED].s == ISS_ON) {
-			gpiod_line_set_value(gpio_dir, 1); // Reverse Motion
-		} else {
-			gpiod_line_set_value(gpio_dir, 0); // Normal Motion
-		}
-	}
-
-	bool isBacklash = false;
-	if (backlashTicksRemaining > 0)
-	{
-		isBacklash = true;
-	}
-
-	// make a single step
-	stepMotor();
-
-	// update absolute position only if processing real steps not backlash
-	if (isBacklash)
-	{
-		backlashTicksRemaining -= 1;
-	}  else {
-		focuserTicksRemaining -= 1;
-		FocusAbsPosN[0].value += 1 * stepperDirection;
-		IDSetNumber(&FocusAbsPosNP, nullptr);
-	}
-
-	SetTimer(FocusStepDelayN[0].value);
-}
-
 bool AstroberryFocuser::ReverseFocuser(bool enabled)
 {
 	if (enabled)
@@ -861,7 +1239,24 @@ bool AstroberryFocuser::ReverseFocuser(bool enabled)
 
 bool AstroberryFocuser::SyncFocuser(uint32_t ticks)
 {
-	savePosition((int) ticks * MAX_RESOLUTION / resolution); // always save at MAX_RESOLUTION
+	if (stepperBusy)
+	{
+		DEBUG(INDI::Logger::DBG_WARNING, "Cannot sync while focuser is moving.");
+		return false;
+	}
+
+	// keep recorded focus positions consistent with new position reference
+	double shift = (int) ticks * MAX_RESOLUTION / resolution - stepperPosition;
+	if (LearningDataN[0].value > 0 && shift != 0)
+	{
+		LearningDataN[2].value += LearningDataN[0].value * shift;
+		LearningDataN[4].value += LearningDataN[1].value * shift;
+		IDSetNumber(&LearningDataNP, nullptr);
+		saveConfig(true, LearningDataNP.name);
+	}
+
+	stepperPosition = (int) ticks * MAX_RESOLUTION / resolution;
+	savePosition(stepperPosition); // always save at MAX_RESOLUTION
 	DEBUGF(INDI::Logger::DBG_SESSION, "Focuser absolute position sync to %d", ticks);
     return true;
 }
@@ -874,27 +1269,20 @@ bool AstroberryFocuser::SetFocuserBacklash(int32_t steps)
 
 bool AstroberryFocuser::AbortFocuser()
 {
-	backlashTicksRemaining = 0;
-	focuserTicksRemaining = 0;
+	stepperAbort = true;
 	DEBUG(INDI::Logger::DBG_SESSION, "Focuser motion aborted.");
 	return true;
 }
 
 IPState AstroberryFocuser::MoveAbsFocuser(uint32_t targetTicks)
 {
-	if (backlashTicksRemaining > 0 || focuserTicksRemaining > 0)
-	{
-		DEBUG(INDI::Logger::DBG_WARNING, "Focuser movement still in progress.");
-		return IPS_BUSY;
-	}
-
 	if (targetTicks < FocusAbsPosN[0].min || targetTicks > FocusAbsPosN[0].max)
 	{
 		DEBUG(INDI::Logger::DBG_WARNING, "Requested position is out of range.");
 		return IPS_ALERT;
 	}
 
-	if (targetTicks == FocusAbsPosN[0].value)
+	if (!stepperBusy && targetTicks == FocusAbsPosN[0].value)
 	{
 		DEBUG(INDI::Logger::DBG_SESSION, "Already at the requested position.");
 		return IPS_OK;
@@ -911,275 +1299,1260 @@ IPState AstroberryFocuser::MoveAbsFocuser(uint32_t targetTicks)
 	{
 		IERmTimer(stepperStandbyID);
 		gpiod_line_set_value(gpio_sleep, 1);
+		stepperPhase = 0; // driver reset to home position
 		DEBUG(INDI::Logger::DBG_SESSION, "Stepper motor waking up.");
 	}
 
 	// set direction
-	const char* directionName;
-	int newDirection;
-	if (targetTicks > FocusAbsPosN[0].value)
+	int position = stepperPosition * resolution / MAX_RESOLUTION;
+	const char* directionName = (int) targetTicks > position ? "outward" : "inward";
+
+	// stepping engine compensates backlash once whenever direction changes
+	StepperCommand command;
+	command.target = (int) targetTicks * MAX_RESOLUTION / resolution;
+	command.backlash = FocusBacklashS[INDI_ENABLED].s == ISS_ON ? (int) FocusBacklashN[0].value * MAX_RESOLUTION / resolution : 0;
+	command.reverse = FocusReverseS[INDI_ENABLED].s == ISS_ON;
+
+	// coarse stepping is used only when coarser than focuser resolution
+	const int coarseResolutions[] = { 0, 1, 2, 4, 8 };
+	int coarse = coarseResolutions[IUFindOnSwitchIndex(&CoarseSteppingSP)];
+	command.resolution = resolution;
+	command.coarse = coarse > 0 && coarse < resolution ? coarse : resolution;
+	command.fineApproach = FineApproachN[0].value * MAX_RESOLUTION;
+	command.updateInterval = 1000000 / PositionUpdateRateN[0].value;
+
+	// plan speed profile, backlash is stepped together with the move when direction changes
+	int direction = (int) targetTicks > position ? 1 : -1;
+	int steps = abs((int) targetTicks - position) + (direction != plannedDirection ? command.backlash * resolution / MAX_RESOLUTION : 0);
+	plannedDirection = direction;
+	planMove(command.profile, steps);
+	DEBUGF(INDI::Logger::DBG_DEBUG, "Planned %d steps with %d accelerating steps in %0.2f seconds.", steps, (int) command.profile.rampSize(), command.profile.duration);
+
+	if (stepperBusy)
 	{
-		newDirection = 1;
-		directionName = "outward";
+		DEBUGF(INDI::Logger::DBG_SESSION, "Focuser is retargeted %s to position %d.", directionName, targetTicks);
 	} else {
-		newDirection = -1;
-		directionName = "inward";
+		DEBUGF(INDI::Logger::DBG_SESSION, "Focuser is moving %s to position %d in %0.1f seconds.", directionName, targetTicks, command.profile.duration);
 	}
 
-	// if direction changed do backlash adjustment
-	if (newDirection != stepperDirection && FocusBacklashN[0].value != 0  && FocusBacklashS[INDI_ENABLED].s == ISS_ON)
+	// record the move, so a restart knows position may be off
+	if (!stepperMoving)
 	{
-		DEBUGF(INDI::Logger::DBG_SESSION, "Compensating backlash by %0.0f steps.", FocusBacklashN[0].value);
-		backlashTicksRemaining = FocusBacklashN[0].value;
-	} else {
-		backlashTicksRemaining = 0;
+		clock_gettime(CLOCK_MONOTONIC, &positionCheckpoint);
+		checkpointPosition();
 	}
 
-	// update last stepper direction
-	stepperDirection = newDirection;
-
-	// process targetTicks
-	focuserTicksRemaining = abs(targetTicks - FocusAbsPosN[0].value);
-	DEBUGF(INDI::Logger::DBG_SESSION, "Focuser is moving %s to position %d.", directionName, targetTicks);
-
-	SetTimer(FocusStepDelayN[0].value);
+	// hand the target over to stepping engine, a running move picks it up between steps
+	stepperTarget = targetTicks;
+	stepperAbort = false;
+	stepperMoving = true;
+	{
+		// busy changes together with pending command, engine clears busy only when no command is pending
+		std::lock_guard<std::mutex> lock(stepperMutex);
+		stepperCommand = std::move(command);
+		stepperCommandPending = true;
+		stepperBusy = true;
+	}
+	stepperCondition.notify_all();
 
 	return IPS_BUSY;
 }
 
 IPState AstroberryFocuser::MoveRelFocuser(FocusDirection dir, uint32_t ticks)
 {
-	uint32_t targetTicks = (uint32_t) FocusAbsPosN[0].value + (ticks * (dir == FOCUS_INWARD ? -1 : 1));
+	// relative moves issued while moving add up to a single continuous move
+	uint32_t position = stepperBusy ? stepperTarget : FocusAbsPosN[0].value;
+	uint32_t targetTicks = position + (ticks * (dir == FOCUS_INWARD ? -1 : 1));
 	return MoveAbsFocuser(targetTicks);
 }
 
-void AstroberryFocuser::stepMotor()
+void AstroberryFocuser::recordStepLatency(const struct timespec &deadline, const struct timespec &now)
 {
-	// step on
-	gpiod_line_set_value(gpio_step, 1);
-	// wait
-	msleep(FocusStepDelayN[0].value);
-	// step off
-	gpiod_line_set_value(gpio_step, 0);
+	int64_t late = (now.tv_sec - deadline.tv_sec) * 1000000LL + (now.tv_nsec - deadline.tv_nsec) / 1000;
+	uint32_t latency = late > 0 ? std::min<int64_t>(late, UINT32_MAX) : 0;
+	unsigned int bin = std::upper_bound(std::begin(STEP_LATENCY_BINS), std::end(STEP_LATENCY_BINS), latency) - std::begin(STEP_LATENCY_BINS);
+	stepLatency[bin].fetch_add(1, std::memory_order_relaxed);
+	uint32_t max = stepLatencyMax.load(std::memory_order_relaxed);
+	while (latency > max && !stepLatencyMax.compare_exchange_weak(max, latency, std::memory_order_relaxed));
 }
 
-void AstroberryFocuser::setResolution(int res)
+void AstroberryFocuser::stepMotor(struct timespec &deadline, uint32_t interval, bool measure)
 {
-	// Release lines
-	gpiod_line_release(gpio_m1);
-	gpiod_line_release(gpio_m2);
-	gpiod_line_release(gpio_m3);
+	// step on
+	sleepUntil(deadline);
+	gpiod_line_set_value(gpio_step, 1);
 
-	if (MotorBoardS[0].s == ISS_ON) {
+	// record how late the step is against schedule
+	if (measure)
+	{
+		struct timespec now;
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		recordStepLatency(deadline, now);
+	}
 
-		/* Stepper motor resolution settings for ==== DRV8834 =====
-		* 1) 1/1   - M1=0 M2=0
-		* 2) 1/2   - M1=1 M2=0
-		* 3) 1/4   - M1=floating M2=0
-		* 4) 1/8   - M1=0 M2=1
-		* 5) 1/16  - M1=1 M2=1
-		* 6) 1/32  - M1=floating M2=1
-		*/
+	// step off half way to the next step
+	addMicroseconds(deadline, interval / 2);
+	sleepUntil(deadline);
+	gpiod_line_set_value(gpio_step, 0);
+	// deadline of the next step
+	addMicroseconds(deadline, interval - interval / 2);
+}
 
-		switch(res)
-		{
-			case 1:	// 1:1
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				break;
-			case 2:	// 1:2
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				break;
-			case 4:	// 1:4
-				gpiod_line_request_output_flags(gpio_m1, "m1@astroberry_focuser", GPIOD_LINE_REQUEST_FLAG_OPEN_DRAIN, 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				break;
-			case 8:	// 1:8
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 1);
-				break;
-			case 16:	// 1:16
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 1);
-				break;
-			case 32:	// 1:32
-				gpiod_line_request_output_flags(gpio_m1, "m1@astroberry_focuser", GPIOD_LINE_REQUEST_FLAG_OPEN_DRAIN, 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 1);
-				break;
-			default:	// 1:1
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				break;
-		}
+void AstroberryFocuser::addMicroseconds(struct timespec &t, uint32_t usec)
+{
+	t.tv_sec += usec / 1000000;
+	t.tv_nsec += (usec % 1000000) * 1000;
+	if (t.tv_nsec >= 1000000000)
+	{
+		t.tv_sec += 1;
+		t.tv_nsec -= 1000000000;
 	}
+}
 
-	if (MotorBoardS[1].s == ISS_ON) {
-
-		/* Stepper motor resolution settings ===== for A4988 =====
-		* 1) 1/1   - M1=0 M2=0 M3=0
-		* 2) 1/2   - M1=1 M2=0 M3=0
-		* 3) 1/4   - M1=0 M2=1 M3=0
-		* 4) 1/8   - M1=1 M2=1 M3=0
-		* 5) 1/16  - M1=1 M2=1 M3=1
-		*/
+bool AstroberryFocuser::timeReached(const struct timespec &now, const struct timespec &t)
+{
+	return now.tv_sec > t.tv_sec || (now.tv_sec == t.tv_sec && now.tv_nsec >= t.tv_nsec);
+}
 
-		switch(res)
-		{
-			case 1:	// 1:1
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 0);
-				break;
-			case 2:	// 1:2
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 0);
-				break;
-			case 4:	// 1:4
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 0);
-				break;
-			case 8:	// 1:8
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 0);
-				break;
-			case 16:	// 1:16
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 1);
-				gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 1);
-				break;
-			default:	// 1:1
-				gpiod_line_request_output(gpio_m1, "m1@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m2, "m2@astroberry_focuser", 0);
-				gpiod_line_request_output(gpio_m3, "m3@astroberry_focuser", 0);
-				break;
-		}
-	}
+void AstroberryFocuser::sleepUntil(const struct timespec &deadline)
+{
+	// absolute deadlines keep timing errors from adding up over a move
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR);
 }
 
-int AstroberryFocuser::savePosition(int pos)
+void AstroberryFocuser::planMove(MotionProfile &profile, int steps)
 {
-	FILE * pFile;
-	char posFileName[MAXRBUF];
-	char buf [100];
+	// step delay is the interval between steps at start speed
+	double startSpeed = 1000000.0 / FocusStepDelayN[0].value;
+	double cruiseSpeed = MotionProfileN[0].value;
+	double acceleration = MotionProfileN[1].value;
 
-	if (getenv("INDICONFIG"))
+	// ramp table is built only when speed settings change, retargeting reuses it
+	if (!plannedRamp.ramp || plannedSettings[0] != startSpeed || plannedSettings[1] != cruiseSpeed || plannedSettings[2] != acceleration)
 	{
-		snprintf(posFileName, MAXRBUF, "%s.position", getenv("INDICONFIG"));
-	} else {
-		snprintf(posFileName, MAXRBUF, "%s/.indi/%s.position", getenv("HOME"), getDeviceName());
-	}
+		plannedSettings[0] = startSpeed;
+		plannedSettings[1] = cruiseSpeed;
+		plannedSettings[2] = acceleration;
 
+		std::vector<uint32_t> ramp;
+		plannedRamp.cruise = lround(1000000.0 / startSpeed);
 
-	if (pos == -1)
-	{
-		pFile = fopen (posFileName,"r");
-		if (pFile == NULL)
+		// trapezoidal profile v = sqrt(v0^2 + 2as), falls back to constant speed
+		if (acceleration > 0 && cruiseSpeed > startSpeed)
 		{
-			DEBUGF(INDI::Logger::DBG_ERROR, "Failed to open file %s.", posFileName);
-			return -1;
+			int rampSteps = ceil((cruiseSpeed * cruiseSpeed - startSpeed * startSpeed) / (2 * acceleration));
+			if (rampSteps > MAX_RAMP_STEPS)
+			{
+				// limit cruise speed to the speed reached at the end of the longest ramp
+				rampSteps = MAX_RAMP_STEPS;
+				cruiseSpeed = sqrt(startSpeed * startSpeed + 2 * acceleration * rampSteps);
+			}
+			ramp.reserve(rampSteps);
+			for (int i = 0; i < rampSteps; i++)
+				ramp.push_back(lround(1000000.0 / sqrt(startSpeed * startSpeed + 2 * acceleration * i)));
+			plannedRamp.cruise = lround(1000000.0 / cruiseSpeed);
 		}
+		plannedRamp.ramp = std::make_shared<const std::vector<uint32_t>>(std::move(ramp));
+	}
+	profile = plannedRamp;
+
+	// short moves get triangular profile
+	uint64_t duration = 0;
+	unsigned int level = 0;
+	for (int toGo = steps; toGo > 0; toGo--)
+		duration += profile.next(level, toGo);
+	profile.duration = duration / 1000000.0;
+}
 
-		fgets (buf , 100, pFile);
-		pos = atoi (buf);
-		DEBUGF(INDI::Logger::DBG_DEBUG, "Reading position %d from %s.", pos, posFileName);
-	} else {
-		pFile = fopen (posFileName,"w");
-		if (pFile == NULL)
-		{
-			DEBUGF(INDI::Logger::DBG_ERROR, "Failed to open file %s.", posFileName);
-			return -1;
-		}
+bool AstroberryFocuser::startStepper()
+{
+	stepperEventFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (stepperEventFD == -1)
+		return false;
 
-		sprintf(buf, "%d", pos);
-		fputs (buf, pFile);
-		DEBUGF(INDI::Logger::DBG_DEBUG, "Writing position %s to %s.", buf, posFileName);
-	}
+	stepperEventID = IEAddCallback(stepperEventFD, stepperEventHelper, this);
 
-	fclose (pFile);
+	stepperExit = false;
+	stepperCommandPending = false;
+	stepperAbort = false;
+	stepperBusy = false;
+	stepperThread = std::thread(&AstroberryFocuser::stepperLoop, this);
 
-	return pos;
+	return true;
 }
 
-bool AstroberryFocuser::readDS18B20()
+void AstroberryFocuser::stopStepper()
 {
-	DIR *dir;
-	struct dirent *dirent;
-	char dev[16];      // Dev ID
-	char devPath[128]; // Path to device
-	char buf[256]; // Data from device
-	char temperatureData[6]; // Temp C * 1000 reported by device
-	char path[] = "/sys/bus/w1/devices";
-	ssize_t numRead;
-	float tempC, tempF;
-
-	dir = opendir (path);
+	if (!stepperThread.joinable())
+		return;
 
-	// search for --the first-- DS18B20 device
-	if (dir != NULL)
+	// abort any move in progress and let the engine exit
+	stepperAbort = true;
 	{
-		while ((dirent = readdir (dir)))
-		{
-			// DS18B20 device is family code beginning with 28-
-			if (dirent->d_type == DT_LNK && strstr(dirent->d_name, "28-") != NULL)
-			{
-				strcpy(dev, dirent->d_name);
-				break;
-			}
-		}
-		(void) closedir (dir);
-	} else {
-		DEBUG(INDI::Logger::DBG_WARNING, "Temperature sensor disabled. 1-Wire interface is not available.");
-		return false;
+		std::lock_guard<std::mutex> lock(stepperMutex);
+		stepperExit = true;
 	}
+	stepperCondition.notify_all();
+	stepperThread.join();
 
-	// Assemble path to --the first-- DS18B20 device
-	sprintf(devPath, "%s/%s/w1_slave", path, dev);
+	IERmCallback(stepperEventID);
+	close(stepperEventFD);
+	stepperEventID = -1;
+	stepperEventFD = -1;
+	stepperBusy = false;
 
-	// Opening the device's file triggers new reading
-	int fd = open(devPath, O_RDONLY);
-	if(fd == -1)
+	// save position of interrupted move
+	if (stepperMoving)
 	{
-		DEBUG(INDI::Logger::DBG_WARNING, "Temperature sensor not available.");
-		return false;
+		stepperMoving = false;
+		FocusAbsPosN[0].value = stepperPosition * resolution / MAX_RESOLUTION;
+		savePosition(stepperPosition); // always save at MAX_RESOLUTION
 	}
+}
 
-	// set busy
-	FocusTemperatureNP.s=IPS_BUSY;
-	IDSetNumber(&FocusTemperatureNP, nullptr);
+void AstroberryFocuser::stepperLoop()
+{
+	// use real-time scheduling for step timing if permitted
+	struct sched_param param;
+	param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+	pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
 
-	// read sensor output
-	while((numRead = read(fd, buf, 256)) > 0);
-	close(fd);
+	std::unique_lock<std::mutex> lock(stepperMutex);
 
-	// parse temperature value from sensor output
-	strncpy(temperatureData, strstr(buf, "t=") + 2, 5);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Temperature sensor raw output: %s", buf);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Temperature string: %s", temperatureData);
+	while (true)
+	{
+		stepperCondition.wait(lock, [this]{ return stepperExit || stepperCommandPending; });
 
-	tempC = strtof(temperatureData, NULL) / 1000;
-	// tempF = (tempC / 1000) * 9 / 5 + 32;
+		if (stepperExit)
+			break;
 
-	// check if temperature is reasonable
-	if(abs(tempC) > 100)
-	{
-		DEBUG(INDI::Logger::DBG_DEBUG, "Temperature reading out of range.");
-		return false;
+		// run the whole move without holding the lock
+		lock.unlock();
+		stepperMove();
+		lock.lock();
+
+		// new target arrived just as the move ended
+		if (stepperCommandPending && !stepperAbort)
+			continue;
+
+		stepperCommandPending = false;
+		stepperBusy = false;
+		stepperCondition.notify_all();
+		stepperNotify();
 	}
+}
 
-	FocusTemperatureN[0].value = tempC;
+void AstroberryFocuser::stepperMove()
+{
+	StepperCommand command;
+	unsigned int level = 0; // speed level in the acceleration ramp, counted in focuser resolution steps
+	int backlash = 0;
+	int mode = 0; // resolution set on the driver, focuser resolution when the move starts
+
+	struct timespec deadline, now, update;
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	update = deadline;
+
+	while (!stepperAbort)
+	{
+		// pick up new target from mailbox
+		if (stepperCommandPending)
+		{
+			std::lock_guard<std::mutex> lock(stepperMutex);
+			command = std::move(stepperCommand);
+			stepperCommandPending = false;
+			if (!mode)
+				mode = command.resolution;
+		}
+
+		// microsteps of a single step at focuser and coarse resolution
+		int fine = MAX_RESOLUTION / command.resolution;
+		int coarse = MAX_RESOLUTION / command.coarse;
+
+		// microsteps left in current direction, negative if target is behind
+		int position = stepperPosition;
+		int toGo = (command.target - position) * stepperDirection + backlash;
+
+		// less than a step at focuser resolution left, stepping would overshoot an unaligned target
+		if (toGo > 0 && toGo < fine)
+			toGo = 0;
+
+		if (toGo <= 0 && level == 0)
+		{
+			if (abs(command.target - position) < fine)
+				break;
+
+			// stopped before target, reverse and compensate backlash once
+			stepperDirection = -stepperDirection;
+			backlash = command.backlash;
+			continue;
+		}
+
+		// handle reverse motion and write dir line only when direction changes
+		int dir = (stepperDirection == 1) != command.reverse ? 1 : 0;
+		if (dir != controlValues[CONTROL_DIR])
+		{
+			std::lock_guard<std::mutex> lock(controlMutex);
+			controlValues[CONTROL_DIR] = dir;
+			gpiod_line_set_value_bulk(&gpio_control, controlValues);
+		}
+
+		// run the bulk of the move at coarse resolution once the driver is on a coarse step,
+		// backlash and final approach are made at focuser resolution
+		bool coarseStep = coarse > fine && backlash == 0 && stepperPhase % coarse == 0 && toGo - coarse >= command.fineApproach;
+		int stepMode = coarseStep ? command.coarse : command.resolution;
+		if (stepMode != mode)
+		{
+			setResolution(stepMode);
+			mode = stepMode;
+		}
+
+		// coarse step takes the time of the focuser resolution steps it spans, so speed profile is kept
+		uint32_t interval = 0;
+		int span = coarseStep ? coarse / fine : 1;
+		for (int i = 0; i < span; i++)
+			interval += command.profile.next(level, toGo / fine - i);
+
+		// restart schedule instead of bursting steps when running late by more than a step
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		struct timespec late = deadline;
+		addMicroseconds(late, interval);
+		bool overrun = timeReached(now, late);
+		if (overrun)
+		{
+			// overrun is the latency of this step, rescheduled step would measure on time
+			recordStepLatency(deadline, now);
+			deadline = now;
+			stepOverruns.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// make a single step
+		stepMotor(deadline, interval, !overrun);
+
+		// backlash steps do not change absolute position
+		int microsteps = MAX_RESOLUTION / mode;
+		if (backlash > 0)
+		{
+			backlash -= microsteps;
+		} else {
+			stepperPosition += stepperDirection * microsteps;
+		}
+		stepperPhase = (stepperPhase + stepperDirection * microsteps + 4 * MAX_RESOLUTION) % (4 * MAX_RESOLUTION);
+
+		// report progress at position update rate, final position is reported at the end of move
+		if (timeReached(now, update))
+		{
+			stepperNotify();
+			update = now;
+			addMicroseconds(update, command.updateInterval);
+		}
+	}
+
+	// leave the driver at focuser resolution
+	if (mode && mode != command.resolution)
+		setResolution(command.resolution);
+}
+
+void AstroberryFocuser::stepperNotify()
+{
+	// wake up main loop, multiple notifications coalesce in the eventfd counter
+	uint64_t event = 1;
+	ssize_t rv = write(stepperEventFD, &event, sizeof(event));
+	INDI_UNUSED(rv);
+}
+
+void AstroberryFocuser::stepperEvent()
+{
+	uint64_t events;
+	ssize_t rv = read(stepperEventFD, &events, sizeof(events));
+	INDI_UNUSED(rv);
+
+	FocusAbsPosN[0].value = stepperPosition * resolution / MAX_RESOLUTION;
+
+	// report progress while moving
+	if (stepperBusy)
+	{
+		IDSetNumber(&FocusAbsPosNP, nullptr);
+		checkpointPosition();
+		return;
+	}
+
+	// ignore stale notifications once the move has been reported
+	if (!stepperMoving)
+		return;
+
+	stepperMoving = false;
+
+	//save position to file
+	savePosition(stepperPosition); // always save at MAX_RESOLUTION
+
+	// update abspos value and status
+	FocusAbsPosNP.s = IPS_OK;
+	IDSetNumber(&FocusAbsPosNP, nullptr);
+	FocusRelPosNP.s = IPS_OK;
+	IDSetNumber(&FocusRelPosNP, nullptr);
+	DEBUGF(INDI::Logger::DBG_SESSION, "Focuser at the position %0.0f.", FocusAbsPosN[0].value);
+
+	// publish step timing of the move
+	updateStepTiming();
+	IDSetNumber(&StepTimingNP, nullptr);
+
+	// reset last temperature
+	lastTemperature = filteredTemperature; // register last temperature
+
+	// autofocus run ends with focuser settled at best focus after a series of client moves
+	if (!compensationMove)
+	{
+		autofocusMoves++;
+		IERmTimer(autofocusSettledID);
+		autofocusSettledID = IEAddTimer(AUTOFOCUS_SETTLE_TIMEOUT, autofocusSettledHelper, this);
+	}
+	compensationMove = false;
+
+	// set motor standby timer
+	if ( StepperStandbyS[0].s == ISS_ON)
+	{
+		if (stepperStandbyID)
+			IERmTimer(stepperStandbyID);
+		stepperStandbyID = IEAddTimer(StepperStandbyTimeN[0].value * 1000, stepperStandbyHelper, this);
+		DEBUGF(INDI::Logger::DBG_SESSION, "Focuser going standby in %d seconds", (int) IERemainingTimer(stepperStandbyID) /  1000);
+	}
+
+	// resolution change requested while moving
+	if (pendingResolution)
+	{
+		changeResolution(pendingResolution);
+		IDSetSwitch(&FocusResolutionSP, nullptr);
+	}
+}
+
+void AstroberryFocuser::resetStepTiming()
+{
+	for (auto &bin : stepLatency)
+		bin = 0;
+	stepOverruns = 0;
+	stepLatencyMax = 0;
+}
+
+void AstroberryFocuser::updateStepTiming()
+{
+	for (int i = 0; i < 8; i++)
+		StepTimingN[i].value = stepLatency[i].load(std::memory_order_relaxed);
+	StepTimingN[8].value = stepOverruns.load(std::memory_order_relaxed);
+	StepTimingN[9].value = stepLatencyMax.load(std::memory_order_relaxed);
+}
+
+void AstroberryFocuser::setResolution(int res)
+{
+	// full step unless resolution is found in truth table
+	int m1 = 0, m2 = 0, m3 = 0;
+
+	if (MotorBoardS[0].s == ISS_ON) {
+		for (const auto &mode : DRV8834_MODES)
+		{
+			if (mode.resolution == res)
+			{
+				m1 = mode.m1;
+				m2 = mode.m2;
+				m3 = mode.m3;
+			}
+		}
+	}
+
+	if (MotorBoardS[1].s == ISS_ON) {
+		for (const auto &mode : A4988_MODES)
+		{
+			if (mode.resolution == res)
+			{
+				m1 = mode.m1;
+				m2 = mode.m2;
+				m3 = mode.m3;
+			}
+		}
+	}
+
+	// mode lines stay requested, may be called from stepping engine between steps
+	std::lock_guard<std::mutex> lock(controlMutex);
+
+	// DRV8834 M1 line is reconfigured in place, open drain output set high leaves the line floating
+	if (MotorBoardS[0].s == ISS_ON)
+	{
+		bool floating = m1 == FLOATING;
+		if (floating != m1Floating)
+		{
+			int flags = floating ? GPIOD_LINE_REQUEST_FLAG_OPEN_DRAIN : 0;
+			int value = floating ? 1 : m1;
+			int rv = gpiod_line_set_config(gpio_m1, GPIOD_LINE_REQUEST_DIRECTION_OUTPUT, flags, value);
+			if (rv != 0)
+			{
+				// kernels before 5.5 cannot reconfigure a requested line
+				gpiod_line_release(gpio_m1);
+				rv = gpiod_line_request_output_flags(gpio_m1, "m1@astroberry_focuser", flags, value);
+			}
+			if (rv == 0)
+				m1Floating = floating;
+			else
+				DEBUGF(INDI::Logger::DBG_ERROR, "Error setting M1 line for resolution 1/%d.", res);
+		} else if (!floating) {
+			gpiod_line_set_value(gpio_m1, m1);
+		}
+	}
+
+	// set mode lines with a single write
+	controlValues[CONTROL_M2] = m2;
+	controlValues[CONTROL_M1] = m1 == FLOATING ? 0 : m1;
+	controlValues[CONTROL_M3] = m3;
+	gpiod_line_set_value_bulk(&gpio_control, controlValues);
+}
+
+static uint32_t positionChecksum(const void *data, size_t size)
+{
+	// CRC-32, bitwise is fast enough for a few bytes
+	const uint8_t *p = (const uint8_t *) data;
+	uint32_t crc = 0xFFFFFFFF;
+	while (size--)
+	{
+		crc ^= *p++;
+		for (int i = 0; i < 8; i++)
+			crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+	}
+	return ~crc;
+}
+
+bool AstroberryFocuser::openPositionStore(int &pos)
+{
+	char legacyFileName[MAXRBUF];
+
+	if (getenv("INDICONFIG"))
+	{
+		snprintf(positionFileName, MAXRBUF, "%s.position.dat", getenv("INDICONFIG"));
+		snprintf(legacyFileName, MAXRBUF, "%s.position", getenv("INDICONFIG"));
+	} else {
+		snprintf(positionFileName, MAXRBUF, "%s/.indi/%s.position.dat", getenv("HOME"), getDeviceName());
+		snprintf(legacyFileName, MAXRBUF, "%s/.indi/%s.position", getenv("HOME"), getDeviceName());
+	}
+
+	positionFD = open(positionFileName, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+	if (positionFD == -1)
+	{
+		DEBUGF(INDI::Logger::DBG_ERROR, "Failed to open file %s.", positionFileName);
+		return false;
+	}
+
+	// use the newest record with valid checksum, a torn write damages only the slot being written
+	bool found = false;
+	PositionRecord record;
+	for (int slot = 0; slot < 2; slot++)
+	{
+		PositionRecord slotRecord;
+		if (pread(positionFD, &slotRecord, sizeof(slotRecord), slot * POSITION_SLOT_SIZE) != sizeof(slotRecord))
+			continue;
+		if (slotRecord.magic != POSITION_MAGIC || slotRecord.checksum != positionChecksum(&slotRecord, offsetof(PositionRecord, checksum)))
+			continue;
+		if (!found || (int32_t) (slotRecord.sequence - record.sequence) > 0)
+		{
+			record = slotRecord;
+			found = true;
+		}
+	}
+
+	if (found)
+	{
+		pos = record.position;
+		positionSequence = record.sequence;
+		DEBUGF(INDI::Logger::DBG_DEBUG, "Reading position %d from %s.", pos, positionFileName);
+		if (record.moving)
+			DEBUGF(INDI::Logger::DBG_WARNING, "Focuser was moving when driver stopped. Position %d may be off by up to %d steps.", pos * resolution / MAX_RESOLUTION, (int) record.uncertainty * resolution / MAX_RESOLUTION);
+	} else {
+		// migrate position saved by older versions
+		FILE *pFile = fopen(legacyFileName, "r");
+		if (pFile == NULL)
+		{
+			DEBUGF(INDI::Logger::DBG_WARNING, "No saved position found in %s.", positionFileName);
+			return false;
+		}
+
+		char buf[100];
+		if (fgets(buf, 100, pFile))
+			pos = atoi(buf);
+		fclose(pFile);
+		DEBUGF(INDI::Logger::DBG_DEBUG, "Reading position %d from %s.", pos, legacyFileName);
+
+		savedMoving = true; // make sure migrated position gets written
+		if (savePosition(pos))
+			unlink(legacyFileName); // legacy file is kept until the new record is on disk
+	}
+
+	savedPosition = pos;
+	savedMoving = found && record.moving;
+	clock_gettime(CLOCK_MONOTONIC, &positionCheckpoint);
+
+	return true;
+}
+
+void AstroberryFocuser::closePositionStore()
+{
+	if (positionFD == -1)
+		return;
+
+	close(positionFD);
+	positionFD = -1;
+}
+
+bool AstroberryFocuser::savePosition(int pos, bool moving)
+{
+	if (positionFD == -1)
+		return false;
+
+	// nothing changed since last write
+	if (pos == savedPosition && moving == savedMoving)
+		return true;
+
+	PositionRecord record;
+	memset(&record, 0, sizeof(record));
+	record.magic = POSITION_MAGIC;
+	record.sequence = ++positionSequence;
+	record.position = pos;
+	record.moving = moving;
+
+	// focuser travel until next checkpoint at the highest planned speed
+	if (moving)
+	{
+		double speed = 1000000.0 / FocusStepDelayN[0].value;
+		if (MotionProfileN[1].value > 0)
+			speed = std::max(speed, MotionProfileN[0].value);
+		double interval = PositionCheckpointN[0].value + 1 / PositionUpdateRateN[0].value;
+		record.uncertainty = ceil(speed * interval) * MAX_RESOLUTION / resolution;
+	}
+
+	record.checksum = positionChecksum(&record, offsetof(PositionRecord, checksum));
+
+	// records are written in turns, so the previous one survives a torn write
+	if (pwrite(positionFD, &record, sizeof(record), (record.sequence % 2) * POSITION_SLOT_SIZE) != sizeof(record) || fdatasync(positionFD) == -1)
+	{
+		DEBUGF(INDI::Logger::DBG_ERROR, "Failed to write position to %s.", positionFileName);
+		return false;
+	}
+
+	savedPosition = pos;
+	savedMoving = moving;
+	DEBUGF(INDI::Logger::DBG_DEBUG, "Writing position %d to %s.", pos, positionFileName);
+	return true;
+}
+
+void AstroberryFocuser::checkpointPosition()
+{
+	// limit writes while moving to save flash memory
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	if (!timeReached(now, positionCheckpoint))
+		return;
+
+	savePosition(stepperPosition, true);
+	positionCheckpoint = now;
+	addMicroseconds(positionCheckpoint, PositionCheckpointN[0].value * 1000000);
+}
+
+void AstroberryFocuser::findDS18B20()
+{
+	DIR *dir;
+	struct dirent *dirent;
+	std::vector<std::string> sensors, masters;
+
+	dir = opendir (W1_DEVICES);
+	if (dir != NULL)
+	{
+		while ((dirent = readdir (dir)))
+		{
+			if (dirent->d_type != DT_LNK)
+				continue;
+
+			// DS18B20 device is family code beginning with 28-
+			if (!strncmp(dirent->d_name, "28-", 3))
+				sensors.push_back(dirent->d_name);
+
+			// bus masters able to convert all sensors at once
+			if (!strncmp(dirent->d_name, "w1_bus_master", 13))
+			{
+				std::string bulkRead = std::string(W1_DEVICES) + "/" + dirent->d_name + "/therm_bulk_read";
+				if (access(bulkRead.c_str(), W_OK) == 0)
+					masters.push_back(bulkRead);
+			}
+		}
+		(void) closedir (dir);
+	}
+	std::sort(sensors.begin(), sensors.end());
+
+	if (sensors != temperatureSensorsFound)
+	{
+		temperatureSensorsFound = sensors;
+		std::string list;
+		for (const auto &sensor : sensors)
+			list += (list.empty() ? "" : ", ") + sensor;
+		DEBUGF(INDI::Logger::DBG_SESSION, "Temperature sensors found: %s", sensors.empty() ? "none" : list.c_str());
+	}
+
+	// use --the first-- DS18B20 device as tube sensor unless sensors are assigned
+	bool assigned = false;
+	for (int i = 0; i < SENSOR_COUNT; i++)
+		assigned |= TemperatureSensorsT[i].text[0] != 0;
+	if (!assigned && !sensors.empty())
+	{
+		IUSaveText(&TemperatureSensorsT[SENSOR_TUBE], sensors[0].c_str());
+		IDSetText(&TemperatureSensorsTP, nullptr);
+	}
+
+	// hand sensors over to sampler when changed, a missing sensor fails to open
+	{
+		std::lock_guard<std::mutex> lock(temperatureMutex);
+		for (int i = 0; i < SENSOR_COUNT; i++)
+		{
+			std::string sensorDir = TemperatureSensorsT[i].text[0] ? std::string(W1_DEVICES) + "/" + TemperatureSensorsT[i].text : "";
+			temperatureConfigChanged |= sensorDir != temperatureSensorDirs[i];
+			temperatureSensorDirs[i] = sensorDir;
+		}
+		temperatureConfigChanged |= masters != temperatureMasters;
+		temperatureMasters = masters;
+	}
+	temperatureCondition.notify_all();
+}
+
+bool AstroberryFocuser::readDS18B20(int &fd, int &temperature)
+{
+	char buf[256]; // Data from device
+	ssize_t numRead, total = 0;
+
+	// read sensor output, blocks for the whole conversion unless converted by bulk read
+	while((numRead = pread(fd, buf + total, sizeof(buf) - 1 - total, total)) > 0)
+		total += numRead;
+
+	// sensor is gone
+	if (numRead == -1 || total == 0)
+	{
+		close(fd);
+		fd = -1;
+		return false;
+	}
+	buf[total] = 0;
+
+	// parse temperature value from sensor output, in °C * 1000
+	char *temperatureData = strstr(buf, "t=");
+	if (temperatureData == NULL || strstr(buf, "YES") == NULL)
+		return false;
+
+	temperature = strtol(temperatureData + 2, NULL, 10);
+
+	// check if temperature is reasonable
+	return abs(temperature) <= 100000;
+}
+
+void AstroberryFocuser::convertDS18B20(const std::vector<std::string> &masters, int conversionTime)
+{
+	bool triggered = false;
+
+	// start conversion on all sensors of each bus at once
+	for (const auto &master : masters)
+	{
+		int fd = open(master.c_str(), O_WRONLY | O_CLOEXEC);
+		if (fd == -1)
+			continue;
+		triggered |= write(fd, "trigger\n", 8) == 8;
+		close(fd);
+	}
+
+	if (!triggered)
+		return;
+
+	// wait for conversion, therm_bulk_read reports -1 while any sensor is converting
+	std::this_thread::sleep_for(std::chrono::milliseconds(conversionTime));
+	for (const auto &master : masters)
+	{
+		for (int retry = 0; retry < 10; retry++)
+		{
+			char buf[8] = { 0 };
+			int fd = open(master.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd == -1)
+				break;
+			ssize_t rv = read(fd, buf, sizeof(buf) - 1);
+			close(fd);
+			if (rv <= 0 || atoi(buf) != -1)
+				break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(conversionTime / 10));
+		}
+	}
+}
+
+int AstroberryFocuser::setDS18B20Resolution(const std::string &sensorDir, int bits)
+{
+	char buf[16];
+	std::string path = sensorDir + "/resolution";
+
+	// w1_therm writes resolution to sensor scratchpad, needs write permission to sysfs attribute
+	int fd = open(path.c_str(), O_WRONLY | O_CLOEXEC);
+	if (fd != -1)
+	{
+		int len = snprintf(buf, sizeof(buf), "%d\n", bits);
+		ssize_t rv = write(fd, buf, len);
+		INDI_UNUSED(rv);
+		close(fd);
+	}
+
+	// resolution reported by sensor
+	fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1)
+		return 0;
+	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	close(fd);
+	if (len <= 0)
+		return 0;
+	buf[len] = 0;
+	return atoi(buf);
+}
+
+bool AstroberryFocuser::startTemperatureSampler()
+{
+	// watch 1-Wire devices for sensors coming and going
+	temperatureWatchFD = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (temperatureWatchFD == -1 || inotify_add_watch(temperatureWatchFD, W1_DEVICES, IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO) == -1)
+	{
+		DEBUG(INDI::Logger::DBG_WARNING, "Temperature sensor disabled. 1-Wire interface is not available.");
+		if (temperatureWatchFD != -1)
+			close(temperatureWatchFD);
+		temperatureWatchFD = -1;
+		return false;
+	}
+
+	temperatureEventFD = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (temperatureEventFD == -1)
+	{
+		close(temperatureWatchFD);
+		temperatureWatchFD = -1;
+		return false;
+	}
+
+	temperatureWatchID = IEAddCallback(temperatureWatchFD, temperatureWatchHelper, this);
+	temperatureEventID = IEAddCallback(temperatureEventFD, temperatureEventHelper, this);
+
+	temperatureSensorsFound.clear();
+	findDS18B20();
+
+	temperatureExit = false;
+	for (auto &sample : temperatureSamples)
+		sample = 0;
+	temperatureSequence = 0;
+	temperatureReady = false;
+	temperatureRingCount = 0;
+	temperatureHistoryCount = 0;
+	temperatureInterval = 0;
+	historyCount = 0;
+	temperatureThread = std::thread(&AstroberryFocuser::temperatureLoop, this);
+
+	return true;
+}
+
+void AstroberryFocuser::stopTemperatureSampler()
+{
+	if (!temperatureThread.joinable())
+		return;
+
+	// sampler exits once current conversion is done
+	{
+		std::lock_guard<std::mutex> lock(temperatureMutex);
+		temperatureExit = true;
+	}
+	temperatureCondition.notify_all();
+	temperatureThread.join();
+
+	IERmCallback(temperatureEventID);
+	close(temperatureEventFD);
+	temperatureEventID = -1;
+	temperatureEventFD = -1;
+
+	IERmCallback(temperatureWatchID);
+	close(temperatureWatchFD);
+	temperatureWatchID = -1;
+	temperatureWatchFD = -1;
+}
+
+void AstroberryFocuser::temperatureLoop()
+{
+	uint32_t sequence = 0;
+	int sensorResolution = 0; // resolution set on sensors in use
+	int fd[SENSOR_COUNT] = { -1, -1, -1 };
+	std::string sensorDirs[SENSOR_COUNT];
+	std::vector<std::string> masters;
+	std::unique_lock<std::mutex> lock(temperatureMutex);
+
+	while (!temperatureExit)
+	{
+		// pick up sensors found by main loop
+		if (temperatureConfigChanged)
+		{
+			for (int i = 0; i < SENSOR_COUNT; i++)
+			{
+				sensorDirs[i] = temperatureSensorDirs[i];
+				if (fd[i] != -1)
+					close(fd[i]);
+				fd[i] = -1;
+			}
+			masters = temperatureMasters;
+		}
+		temperatureConfigChanged = false;
+
+		// 1-Wire conversion is slow, do not hold the lock
+		lock.unlock();
+
+		// open sensors, each read from the start gets new temperature
+		bool opened = false, found = false;
+		for (int i = 0; i < SENSOR_COUNT; i++)
+		{
+			if (fd[i] == -1 && !sensorDirs[i].empty())
+			{
+				fd[i] = open((sensorDirs[i] + "/w1_slave").c_str(), O_RDONLY | O_CLOEXEC);
+				opened |= fd[i] != -1;
+			}
+			found |= fd[i] != -1;
+		}
+
+		// apply requested resolution to all sensors
+		if (opened)
+			sensorResolution = 0;
+		if (found && sensorResolution != temperatureResolution)
+		{
+			sensorResolution = temperatureResolution;
+			for (int i = 0; i < SENSOR_COUNT; i++)
+				if (fd[i] != -1 && setDS18B20Resolution(sensorDirs[i], temperatureResolution) != temperatureResolution)
+					sensorResolution = 0;
+			temperatureResolutionApplied = sensorResolution;
+		}
+
+		// conversion takes 94 ms at 9 bit and doubles with each bit
+		int bits = sensorResolution >= 9 && sensorResolution <= 12 ? sensorResolution : 12;
+		int conversionTime = 94 << (bits - 9);
+
+		// convert all sensors in parallel, each sensor converts in turn when read otherwise
+		if (found)
+			convertDS18B20(masters, conversionTime);
+
+		int temperature[SENSOR_COUNT];
+		for (int i = 0; i < SENSOR_COUNT; i++)
+		{
+			temperature[i] = TEMPERATURE_NO_SENSOR;
+			if (fd[i] != -1 && !readDS18B20(fd[i], temperature[i]))
+				temperature[i] = fd[i] == -1 ? TEMPERATURE_NO_SENSOR : TEMPERATURE_INVALID;
+		}
+		lock.lock();
+
+		// publish latest samples and wake up main loop
+		sequence++;
+		for (int i = 0; i < SENSOR_COUNT; i++)
+			temperatureSamples[i] = (uint64_t) sequence << 32 | (uint32_t) temperature[i];
+		uint64_t event = 1;
+		ssize_t rv = write(temperatureEventFD, &event, sizeof(event));
+		INDI_UNUSED(rv);
+
+		// wait for next sample, compensation may reschedule it while waiting
+		auto sampled = std::chrono::steady_clock::now();
+		while (!temperatureExit && !temperatureConfigChanged)
+		{
+			temperatureScheduleChanged = false;
+
+			// sample less often at higher resolution unless compensation asks for a sample
+			auto period = std::chrono::milliseconds(conversionTime) * TEMPERATURE_SAMPLE_RATIO;
+			if (temperatureInterval > 0)
+				period = std::chrono::milliseconds(temperatureInterval);
+
+			if (!temperatureCondition.wait_until(lock, sampled + period, [this]{ return temperatureExit || temperatureConfigChanged || temperatureScheduleChanged; }))
+				break;
+		}
+	}
+
+	for (int i = 0; i < SENSOR_COUNT; i++)
+		if (fd[i] != -1)
+			close(fd[i]);
+}
+
+void AstroberryFocuser::temperatureWatchEvent()
+{
+	char events[4096];
+	while (read(temperatureWatchFD, events, sizeof(events)) > 0);
+
+	// 1-Wire devices changed
+	findDS18B20();
+}
+
+void AstroberryFocuser::temperatureEvent()
+{
+	uint64_t events;
+	ssize_t rv = read(temperatureEventFD, &events, sizeof(events));
+	INDI_UNUSED(rv);
+
+	uint32_t sequence = 0;
+	int temperature[SENSOR_COUNT];
+	for (int i = 0; i < SENSOR_COUNT; i++)
+	{
+		uint64_t sample = temperatureSamples[i];
+		sequence = std::max(sequence, (uint32_t) (sample >> 32));
+		temperature[i] = (int32_t) (sample & 0xFFFFFFFF);
+	}
+
+	if (sequence == temperatureSequence)
+		return;
+
+	temperatureSequence = sequence;
+
+	// compensation follows average of selected sensors
+	double sum = 0;
+	int count = 0;
+	bool missing = false, assigned = false;
+	for (int i = 0; i < SENSOR_COUNT; i++)
+	{
+		bool valid = temperature[i] != TEMPERATURE_NO_SENSOR && temperature[i] != TEMPERATURE_INVALID;
+		TemperatureSensorsN[i].value = valid ? temperature[i] / 1000.0 : 0;
+		if (valid && TemperatureSourceS[i].s == ISS_ON)
+		{
+			sum += TemperatureSensorsN[i].value;
+			count++;
+		}
+		assigned |= TemperatureSensorsT[i].text[0] != 0;
+		missing |= TemperatureSensorsT[i].text[0] != 0 && temperature[i] == TEMPERATURE_NO_SENSOR;
+	}
+
+	// report resolution change, sample is taken after resolution is applied
+	if (TemperatureResolutionSP.s == IPS_BUSY)
+	{
+		if (temperatureResolutionApplied == temperatureResolution)
+		{
+			TemperatureResolutionSP.s = IPS_OK;
+			DEBUGF(INDI::Logger::DBG_SESSION, "Temperature sensor resolution set to %d bits.", (int) temperatureResolution);
+		} else {
+			TemperatureResolutionSP.s = IPS_ALERT;
+			DEBUG(INDI::Logger::DBG_WARNING, "Cannot set temperature sensor resolution. Check permissions of w1_therm resolution attribute.");
+		}
+		IDSetSwitch(&TemperatureResolutionSP, nullptr);
+	}
+
+	// look for sensors again, sysfs does not always notify about 1-Wire devices
+	if (missing || !assigned)
+		findDS18B20();
+
+	if (temperatureReady)
+	{
+		TemperatureSensorsNP.s = missing ? IPS_ALERT : IPS_OK;
+		IDSetNumber(&TemperatureSensorsNP, nullptr);
+	}
+
+	if (count == 0)
+	{
+		// warn once when sensors are missing or go away
+		bool reported = temperatureReady ? FocusTemperatureNP.s == IPS_ALERT : sequence > 1;
+		if (!reported)
+			DEBUG(INDI::Logger::DBG_WARNING, "Temperature sensor not available.");
+
+		if (temperatureReady && FocusTemperatureNP.s != IPS_ALERT)
+		{
+			FocusTemperatureNP.s=IPS_ALERT;
+			IDSetNumber(&FocusTemperatureNP, nullptr);
+		}
+		DEBUG(INDI::Logger::DBG_DEBUG, "Temperature reading failed.");
+		return;
+	}
+
+	FocusTemperatureN[0].value = sum / count;
+	filterTemperature();
+
+	// define temperature properties with the first reading
+	if (!temperatureReady)
+	{
+		lastTemperature = filteredTemperature;
+		temperatureReady = true;
+		defineNumber(&FocusTemperatureNP);
+		defineNumber(&FilteredTemperatureNP);
+		defineNumber(&TemperatureFilterNP);
+		defineNumber(&CompensationDeadlineNP);
+		defineSwitch(&TemperatureHistorySP);
+		defineBLOB(&TemperatureHistoryBP);
+		learningDataLoading = true;
+		loadConfig(true, LearningDataNP.name);
+		learningDataLoading = false;
+		updateLearnedModel();
+		defineSwitch(&TemperatureModelSP);
+		defineSwitch(&FocusLearningSP);
+		defineNumber(&LearnedModelNP);
+		defineSwitch(&AutoRecordSP);
+		defineNumber(&LearningDataNP);
+		defineNumber(&TemperatureSensorsNP);
+		defineSwitch(&TemperatureSourceSP);
+		defineNumber(&TemperatureCoefNP);
+		defineSwitch(&TemperatureCompensateSP);
+		defineSwitch(&TemperatureResolutionSP);
+		DEBUG(INDI::Logger::DBG_SESSION, "Temperature sensor found.");
+	}
 
-	// set OK
 	FocusTemperatureNP.s=IPS_OK;
 	IDSetNumber(&FocusTemperatureNP, nullptr);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Temperature: %.2f°C", tempC);
+	FilteredTemperatureNP.s=IPS_OK;
+	IDSetNumber(&FilteredTemperatureNP, nullptr);
+	DEBUGF(INDI::Logger::DBG_DEBUG, "Temperature: %.2f°C, filtered: %.2f°C", FocusTemperatureN[0].value, filteredTemperature);
+
+	recordHistory(HISTORY_SAMPLE, 0);
+
+	// every sample is checked for compensation
+	temperatureCompensation();
+}
+
+void AstroberryFocuser::autofocusSettled()
+{
+	autofocusSettledID = -1;
+
+	if (AutoRecordS[0].s == ISS_ON && autofocusMoves >= AUTOFOCUS_MIN_MOVES)
+	{
+		DEBUGF(INDI::Logger::DBG_SESSION, "Autofocus run of %d moves detected.", autofocusMoves);
+		recordFocus();
+	}
+
+	autofocusMoves = 0;
+}
+
+void AstroberryFocuser::recordFocus()
+{
+	if (!temperatureReady || stepperBusy)
+	{
+		DEBUG(INDI::Logger::DBG_WARNING, "Cannot record focus position without temperature or while focuser is moving.");
+		return;
+	}
+
+	// add focus position at MAX_RESOLUTION to running sums, history is not kept
+	double t = filteredTemperature;
+	double p = stepperPosition;
+	LearningDataN[0].value += 1;
+	LearningDataN[1].value += t;
+	LearningDataN[2].value += p;
+	LearningDataN[3].value += t * t;
+	LearningDataN[4].value += t * p;
+	IDSetNumber(&LearningDataNP, nullptr);
+	saveConfig(true, LearningDataNP.name);
+
+	updateLearnedModel();
+	IDSetNumber(&LearnedModelNP, nullptr);
+	DEBUGF(INDI::Logger::DBG_SESSION, "Focus position %0.0f recorded at %0.2f°C.", FocusAbsPosN[0].value, t);
+}
 
+bool AstroberryFocuser::learnedSlope(double &slope)
+{
+	// least squares fit of position to temperature, needs temperature spread
+	double n = LearningDataN[0].value;
+	if (n < LEARNING_MIN_SAMPLES)
+		return false;
+
+	double varianceT = LearningDataN[3].value - LearningDataN[1].value * LearningDataN[1].value / n;
+	if (varianceT / n < LEARNING_MIN_SPREAD * LEARNING_MIN_SPREAD)
+		return false;
+
+	slope = (LearningDataN[4].value - LearningDataN[1].value * LearningDataN[2].value / n) / varianceT; // microsteps per °C
 	return true;
 }
 
+void AstroberryFocuser::updateLearnedModel()
+{
+	double slope;
+	LearnedModelNP.s = learnedSlope(slope) ? IPS_OK : IPS_IDLE;
+	LearnedModelN[0].value = LearnedModelNP.s == IPS_OK ? slope * resolution / MAX_RESOLUTION : 0;
+	LearnedModelN[1].value = LearningDataN[0].value;
+}
+
+void AstroberryFocuser::filterTemperature()
+{
+	// median of last three samples drops single sample spikes
+	temperatureRing[temperatureRingCount++ % 3] = FocusTemperatureN[0].value;
+	float median = FocusTemperatureN[0].value;
+	if (temperatureRingCount >= 3)
+	{
+		float a = temperatureRing[0], b = temperatureRing[1], c = temperatureRing[2];
+		median = std::max(std::min(a, b), std::min(std::max(a, b), c));
+	}
+
+	// exponential moving average over given number of samples
+	if (temperatureRingCount == 1)
+	{
+		filteredTemperature = median;
+	} else {
+		float alpha = 2 / (TemperatureFilterN[0].value + 1);
+		filteredTemperature += alpha * (median - filteredTemperature);
+	}
+
+	FilteredTemperatureN[0].value = filteredTemperature;
+
+	// keep recent filtered samples for temperature rate
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	int size = sizeof(temperatureHistory) / sizeof(temperatureHistory[0]);
+	temperatureHistory[temperatureHistoryCount++ % size] = { now.tv_sec + now.tv_nsec / 1e9, filteredTemperature };
+}
+
+double AstroberryFocuser::temperatureRate()
+{
+	// least squares slope of recent filtered samples in °C per second
+	int size = sizeof(temperatureHistory) / sizeof(temperatureHistory[0]);
+	int n = std::min(temperatureHistoryCount, size);
+	if (n < 2)
+		return 0;
+
+	double t0 = temperatureHistory[0].time;
+	double st = 0, sy = 0, stt = 0, sty = 0;
+	for (int i = 0; i < n; i++)
+	{
+		double t = temperatureHistory[i].time - t0;
+		st += t;
+		sy += temperatureHistory[i].temperature;
+		stt += t * t;
+		sty += t * temperatureHistory[i].temperature;
+	}
+
+	double variance = stt - st * st / n;
+	return variance > 0 ? (sty - st * sy / n) / variance : 0;
+}
+
+void AstroberryFocuser::recordHistory(uint16_t type, int adjustment)
+{
+	// kept at MAX_RESOLUTION, auto resolution may change units during session
+	HistoryRecord &record = history[historyCount++ % (sizeof(history) / sizeof(history[0]))];
+	record.time = time(nullptr);
+	record.temperature = round(filteredTemperature * 100);
+	record.type = type;
+	record.position = stepperPosition;
+	record.adjustment = adjustment * MAX_RESOLUTION / resolution;
+}
+
+void AstroberryFocuser::sendHistory()
+{
+	// oldest record first, written byte by byte so layout does not depend on host
+	uint32_t size = std::min(historyCount, (uint32_t) (sizeof(history) / sizeof(history[0])));
+	historyBlob.resize(size * HISTORY_RECORD_SIZE);
+	uint8_t *p = historyBlob.data();
+	auto put = [&p](uint32_t value, int bytes)
+	{
+		for (int i = 0; i < bytes; i++)
+			*p++ = value >> (8 * i);
+	};
+	for (uint32_t i = 0; i < size; i++)
+	{
+		const HistoryRecord &record = history[(historyCount - size + i) % (sizeof(history) / sizeof(history[0]))];
+		put(record.time, 4);
+		put((uint16_t) record.temperature, 2);
+		put(record.type, 2);
+		put((uint32_t) (record.position * resolution / MAX_RESOLUTION), 4);
+		put((uint32_t) (record.adjustment * resolution / MAX_RESOLUTION), 4);
+	}
+
+	TemperatureHistoryB[0].blob = historyBlob.data();
+	TemperatureHistoryB[0].bloblen = historyBlob.size();
+	TemperatureHistoryB[0].size = historyBlob.size();
+	TemperatureHistoryBP.s = IPS_OK;
+	IDSetBLOB(&TemperatureHistoryBP, nullptr);
+	DEBUGF(INDI::Logger::DBG_DEBUG, "Temperature history of %u records sent.", size);
+}
+
 void AstroberryFocuser::getFocuserInfo()
 {
 	// https://www.innovationsforesight.com/education/how-much-focus-error-is-too-much/
@@ -1223,37 +2596,166 @@ void AstroberryFocuser::getFocuserInfo()
 	DEBUGF(INDI::Logger::DBG_DEBUG, "Focuser Info: %0.2f %0.2f %0.2f.", FocuserInfoN[0].value, FocuserInfoN[1].value, FocuserInfoN[2].value);
 }
 
+void AstroberryFocuser::changeResolution(int new_resolution)
+{
+	int last_resolution = resolution;
+
+	// apply when focuser stops
+	if (stepperBusy || stepperMoving)
+	{
+		pendingResolution = new_resolution;
+		FocusResolutionSP.s = IPS_BUSY;
+		DEBUGF(INDI::Logger::DBG_SESSION, "Focuser resolution 1/%d will be set when focuser stops.", new_resolution);
+		return;
+	}
+
+	pendingResolution = 0;
+	FocusResolutionSP.s = IPS_OK;
+
+	if (new_resolution == last_resolution)
+		return;
+
+	// Adjust position to a step in lower resolution
+	int position_adjustment = last_resolution * (FocusAbsPosN[0].value / last_resolution - (int) FocusAbsPosN[0].value / last_resolution);
+	if ( new_resolution < last_resolution && position_adjustment > 0 )
+	{
+		if ( (float) position_adjustment / last_resolution < 0.5)
+		{
+			position_adjustment *= -1;
+		} else {
+			position_adjustment = last_resolution - position_adjustment;
+		}
+		DEBUGF(INDI::Logger::DBG_SESSION, "Focuser position adjusted by %d steps at 1/%d resolution to sync with 1/%d resolution.", position_adjustment, last_resolution, new_resolution);
+		if (MoveAbsFocuser(FocusAbsPosN[0].value + position_adjustment) == IPS_BUSY)
+		{
+			// switch resolution from stepperEvent when adjustment finishes
+			compensationMove = true; // not a client move
+			pendingResolution = new_resolution;
+			FocusResolutionSP.s = IPS_BUSY;
+			return;
+		}
+	}
+
+	resolution = new_resolution;
+	setResolution(resolution);
+
+	// update values based on resolution
+	FocusMaxPosN[0].max = (int) FocusMaxPosN[0].max * resolution / last_resolution;
+	FocusMaxPosN[0].step = (int) FocusMaxPosN[0].step * resolution / last_resolution;
+	FocusMaxPosN[0].value = (int) FocusMaxPosN[0].value * resolution / last_resolution;
+	IDSetNumber(&FocusMaxPosNP, nullptr);
+	IUUpdateMinMax(&FocusMaxPosNP); // This call is not INDI protocol compliant
+
+	FocusAbsPosN[0].max = (int) FocusAbsPosN[0].max * resolution / last_resolution;
+	FocusAbsPosN[0].step = (int) FocusAbsPosN[0].step * resolution / last_resolution;
+	FocusAbsPosN[0].value = (int) FocusAbsPosN[0].value * resolution / last_resolution;
+	IDSetNumber(&FocusAbsPosNP, nullptr);
+
+	// keep engine position on a step of new resolution if adjustment could not be made
+	if (stepperPosition % (MAX_RESOLUTION / resolution))
+	{
+		stepperPosition = (int) FocusAbsPosN[0].value * MAX_RESOLUTION / resolution;
+		savePosition(stepperPosition); // always save at MAX_RESOLUTION
+		DEBUGF(INDI::Logger::DBG_WARNING, "Focuser position rebased to %0.0f at 1/%d resolution.", FocusAbsPosN[0].value, resolution);
+	}
+	IUUpdateMinMax(&FocusAbsPosNP); // This call is not INDI protocol compliant
+
+	FocusRelPosN[0].max = (int) FocusRelPosN[0].max * resolution / last_resolution;
+	FocusRelPosN[0].step = (int) FocusRelPosN[0].step * resolution / last_resolution;
+	FocusRelPosN[0].value = (int) FocusRelPosN[0].value * resolution / last_resolution;
+	IDSetNumber(&FocusRelPosNP, nullptr);
+	IUUpdateMinMax(&FocusRelPosNP); // This call is not INDI protocol compliant
+
+	FocusSyncN[0].max = FocusSyncN[0].max * resolution / last_resolution;
+	FocusSyncN[0].step = FocusSyncN[0].step * resolution / last_resolution;
+	FocusSyncN[0].value = FocusSyncN[0].value * resolution / last_resolution;
+	IDSetNumber(&FocusSyncNP, nullptr);
+	IUUpdateMinMax(&FocusSyncNP); // This call is not INDI protocol compliant
+
+	FocusBacklashN[0].max = (int) FocusBacklashN[0].max * resolution / last_resolution;
+	FocusBacklashN[0].step = (int) FocusBacklashN[0].step * resolution / last_resolution;
+	FocusBacklashN[0].value = (int) FocusBacklashN[0].value * resolution / last_resolution;
+	IDSetNumber(&FocusBacklashNP, nullptr);
+	IUUpdateMinMax(&FocusBacklashNP); // This call is not INDI protocol compliant
+
+	PresetN[0].value = (int) PresetN[0].value * resolution / last_resolution;
+	PresetN[1].value = (int) PresetN[1].value * resolution / last_resolution;
+	PresetN[2].value = (int) PresetN[2].value * resolution / last_resolution;
+	IDSetNumber(&PresetNP, nullptr);
+
+	getFocuserInfo();
+	updateLearnedModel();
+	IDSetNumber(&LearnedModelNP, nullptr);
+
+	DEBUGF(INDI::Logger::DBG_SESSION, "Focuser resolution set to 1/%d.", resolution);
+}
+
+void AstroberryFocuser::autoResolution()
+{
+	if ( FocusResolutionS[6].s != ISS_ON || !isConnected() )
+		return;
+
+	// steps per critical focus zone at full step
+	float steps_per_cfz = FocuserInfoN[2].value / resolution;
+	if ( steps_per_cfz <= 0 )
+	{
+		DEBUG(INDI::Logger::DBG_WARNING, "Cannot select focuser resolution without critical focus zone.");
+		return;
+	}
+
+	// coarsest resolution giving requested steps per critical focus zone
+	int max_resolution = MotorBoardS[1].s == ISS_ON ? 16 : 32;
+	int new_resolution = 1;
+	while ( new_resolution < max_resolution && steps_per_cfz * new_resolution < AutoResolutionN[0].value )
+		new_resolution *= 2;
+
+	if ( new_resolution != resolution )
+		DEBUGF(INDI::Logger::DBG_SESSION, "Auto resolution 1/%d gives %0.1f steps per critical focus zone.", new_resolution, steps_per_cfz * new_resolution);
+
+	changeResolution(new_resolution);
+	IDSetSwitch(&FocusResolutionSP, nullptr);
+}
+
 void AstroberryFocuser::stepperStandbyHelper(void *context)
 {
 	static_cast<AstroberryFocuser*>(context)->stepperStandby();
 }
 
-void AstroberryFocuser::updateTemperatureHelper(void *context)
+void AstroberryFocuser::autofocusSettledHelper(void *context)
 {
-	static_cast<AstroberryFocuser*>(context)->updateTemperature();
+	static_cast<AstroberryFocuser*>(context)->autofocusSettled();
 }
 
-void AstroberryFocuser::temperatureCompensationHelper(void *context)
+void AstroberryFocuser::compensationDeadlineHelper(void *context)
 {
-	static_cast<AstroberryFocuser*>(context)->temperatureCompensation();
+	static_cast<AstroberryFocuser*>(context)->compensationDeadline();
 }
 
-void AstroberryFocuser::stepperStandby()
+void AstroberryFocuser::stepperEventHelper(int fd, void *context)
 {
-	if (!isConnected())
-		return;
+	INDI_UNUSED(fd);
+	static_cast<AstroberryFocuser*>(context)->stepperEvent();
+}
 
-	gpiod_line_set_value(gpio_sleep, 0); // set stepper motor asleep
-	DEBUG(INDI::Logger::DBG_SESSION, "Stepper motor going standby.");
+void AstroberryFocuser::temperatureEventHelper(int fd, void *context)
+{
+	INDI_UNUSED(fd);
+	static_cast<AstroberryFocuser*>(context)->temperatureEvent();
 }
 
-void AstroberryFocuser::updateTemperature()
+void AstroberryFocuser::temperatureWatchHelper(int fd, void *context)
+{
+	INDI_UNUSED(fd);
+	static_cast<AstroberryFocuser*>(context)->temperatureWatchEvent();
+}
+
+void AstroberryFocuser::stepperStandby()
 {
 	if (!isConnected())
 		return;
 
-	readDS18B20();
-	updateTemperatureID = IEAddTimer(TEMPERATURE_UPDATE_TIMEOUT, updateTemperatureHelper, this);
+	gpiod_line_set_value(gpio_sleep, 0); // set stepper motor asleep
+	DEBUG(INDI::Logger::DBG_SESSION, "Stepper motor going standby.");
 }
 
 void AstroberryFocuser::temperatureCompensation()
@@ -1261,22 +2763,125 @@ void AstroberryFocuser::temperatureCompensation()
 	if (!isConnected())
 		return;
 
-	if ( TemperatureCompensateS[0].s == ISS_ON && FocusTemperatureN[0].value != lastTemperature )
+	if ( TemperatureCompensateS[0].s != ISS_ON || !temperatureReady )
+	{
+		IERmTimer(compensationDeadlineID);
+		compensationDeadlineID = -1;
+		compensationDeferred = false;
+		compensationOverdue = false;
+		scheduleTemperature(0, 0);
+		return;
+	}
+
+	float deltaTemperature = filteredTemperature - lastTemperature; // change of filtered temperature from last focuser movement
+	float thermalExpansionRatio; // termal expansion in micrometers per 1 celcius degree
+	float thermalExpansion;
+	int thermalAdjustment;
+	double slope;
+
+	if (TemperatureModelS[1].s == ISS_ON && learnedSlope(slope))
 	{
-		float deltaTemperature = FocusTemperatureN[0].value - lastTemperature; // change of temperature from last focuser movement
-		float thermalExpansionRatio = TemperatureCoefN[0].value * ScopeParametersN[1].value / 1000; // termal expansion in micrometers per 1 celcius degree
-		float thermalExpansion = thermalExpansionRatio * deltaTemperature; // actual thermal expansion
+		// learned model gives focus position change directly
+		thermalExpansionRatio = fabs(slope) * resolution * FocuserInfoN[0].value / MAX_RESOLUTION;
+		thermalAdjustment = round(slope * deltaTemperature * resolution / MAX_RESOLUTION);
+		thermalExpansion = thermalAdjustment * FocuserInfoN[0].value;
+	} else {
+		thermalExpansionRatio = TemperatureCoefN[0].value * ScopeParametersN[1].value / 1000;
+		thermalExpansion = thermalExpansionRatio * deltaTemperature; // actual thermal expansion
+		thermalAdjustment = round((thermalExpansion / FocuserInfoN[0].value) / 2); // adjust focuser by half number of steps to keep it in the center of cfz
+	}
 
+	if ( deltaTemperature != 0 )
+	{
 		DEBUGF(INDI::Logger::DBG_DEBUG, "Thermal expansion of %0.1f μm due to temperature change of %0.2f°C", thermalExpansion, deltaTemperature);
 
-		if ( abs(thermalExpansion) > FocuserInfoN[1].value / 2)
+		// move only when drift exceeds given fraction of cfz, so sensor noise does not move focuser
+		bool overThreshold = fabs(thermalExpansion) > FocuserInfoN[1].value * TemperatureFilterN[1].value;
+		bool exceeded = overThreshold && thermalAdjustment != 0;
+
+		// drift below a step cannot be corrected, keep default sampling until it grows to a step
+		if (overThreshold && !exceeded)
+			thermalExpansionRatio = 0;
+
+		// do not move during exposure, wait for end of frame until deadline
+		if ( exceeded && exposureActive && !compensationOverdue && CompensationDeadlineN[0].value > 0 )
 		{
-			int thermalAdjustment = round((thermalExpansion / FocuserInfoN[0].value) / 2); // adjust focuser by half number of steps to keep it in the center of cfz
-			MoveAbsFocuser(FocusAbsPosN[0].value + thermalAdjustment); // adjust focuser position
-			lastTemperature = FocusTemperatureN[0].value; // register last temperature
+			if (!compensationDeferred)
+			{
+				compensationDeferred = true;
+				compensationDeadlineID = IEAddTimer(CompensationDeadlineN[0].value * 1000, compensationDeadlineHelper, this);
+				DEBUGF(INDI::Logger::DBG_SESSION, "Focuser adjustment by %d steps deferred until end of exposure.", thermalAdjustment);
+			}
+			scheduleTemperature(0, 0); // end of exposure triggers compensation
+			return;
+		}
+
+		if (compensationDeferred && !exceeded)
+			DEBUG(INDI::Logger::DBG_SESSION, "Deferred focuser adjustment no longer needed.");
+
+		IERmTimer(compensationDeadlineID);
+		compensationDeadlineID = -1;
+		compensationDeferred = false;
+		compensationOverdue = false;
+
+		// client move in progress, its end registers temperature at the new focus
+		if ( exceeded && (stepperBusy || stepperMoving) )
+		{
+			DEBUGF(INDI::Logger::DBG_DEBUG, "Focuser adjustment by %d steps skipped, focuser is moving.", thermalAdjustment);
+		}
+		else if ( exceeded )
+		{
+			compensationMove = MoveAbsFocuser(FocusAbsPosN[0].value + thermalAdjustment) == IPS_BUSY; // adjust focuser position
+			lastTemperature = filteredTemperature; // register last temperature
+			recordHistory(HISTORY_MOVE, thermalAdjustment);
 			DEBUGF(INDI::Logger::DBG_SESSION, "Focuser adjusted by %d steps due to temperature change by %0.2f°C", thermalAdjustment, deltaTemperature);
+			deltaTemperature = 0;
 		}
 	}
 
-	temperatureCompensationID = IEAddTimer(TEMPERATURE_COMPENSATION_TIMEOUT, temperatureCompensationHelper, this);
+	scheduleTemperature(deltaTemperature, thermalExpansionRatio);
+}
+
+void AstroberryFocuser::compensationDeadline()
+{
+	compensationDeadlineID = -1;
+	compensationOverdue = true;
+	DEBUG(INDI::Logger::DBG_WARNING, "Exposure deferral deadline reached, adjusting focuser during exposure.");
+	temperatureCompensation();
+}
+
+void AstroberryFocuser::exposureEvent(bool active)
+{
+	if (active == exposureActive)
+		return;
+
+	exposureActive = active;
+	DEBUGF(INDI::Logger::DBG_DEBUG, "Exposure %s.", active ? "started" : "finished");
+
+	// run deferred compensation between frames
+	if (!exposureActive && compensationDeferred)
+		temperatureCompensation();
+}
+
+void AstroberryFocuser::scheduleTemperature(float deltaTemperature, float thermalExpansionRatio)
+{
+	int interval = 0; // default sample period
+
+	// predict when drift crosses given fraction of cfz and sample at that moment
+	double rate = temperatureRate();
+	if (thermalExpansionRatio > 0 && rate != 0)
+	{
+		double threshold = FocuserInfoN[1].value * TemperatureFilterN[1].value / thermalExpansionRatio; // temperature change crossing threshold
+		double remaining = threshold - (rate > 0 ? deltaTemperature : -deltaTemperature);
+		interval = std::max(TEMPERATURE_MIN_INTERVAL, (int) std::min(remaining / fabs(rate) * 1000, (double) TEMPERATURE_MAX_INTERVAL));
+		DEBUGF(INDI::Logger::DBG_DEBUG, "Temperature rate %0.3f°C/h, next sample in %d s", rate * 3600, interval / 1000);
+	}
+
+	if (interval == temperatureInterval)
+		return;
+
+	temperatureInterval = interval;
+	std::lock_guard<std::mutex> lock(temperatureMutex);
+	temperatureScheduleChanged = true;
+	temperatureCondition.notify_one();
 }
@@ -19,7 +19,17 @@
 #ifndef FOCUSRPI_H
 #define FOCUSRPI_H
 
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+
 #include <indifocuser.h>
+#include <gpiod.h>
 
 class AstroberryFocuser : public INDI::Focuser
 {
@@ -35,8 +45,11 @@ public:
 	virtual bool ISNewText (const char *dev, const char *name, char *texts[], char *names[], int n);
 	virtual bool ISSnoopDevice(XMLEle *root);
 	static void stepperStandbyHelper(void *context);
-	static void updateTemperatureHelper(void *context);
-	static void temperatureCompensationHelper(void *context);
+	static void autofocusSettledHelper(void *context);
+	static void compensationDeadlineHelper(void *context);
+	static void stepperEventHelper(int fd, void *context);
+	static void temperatureEventHelper(int fd, void *context);
+	static void temperatureWatchHelper(int fd, void *context);
 protected:
 	virtual IPState MoveAbsFocuser(uint32_t ticks) override;
 	virtual IPState MoveRelFocuser(FocusDirection dir, uint32_t ticks) override;
@@ -44,25 +57,62 @@ protected:
 	virtual bool SyncFocuser(uint32_t ticks) override;
 	virtual bool SetFocuserBacklash(int32_t steps) override;
 	virtual bool AbortFocuser() override;
-	virtual void TimerHit() override;
 	virtual bool saveConfigItems(FILE *fp) override;
 private:
 	virtual bool Connect();
 	virtual bool Disconnect();
 
-	virtual void stepMotor();
+	virtual void stepMotor(struct timespec &deadline, uint32_t interval, bool measure = true);
+	void recordStepLatency(const struct timespec &deadline, const struct timespec &now);
+	static void addMicroseconds(struct timespec &t, uint32_t usec);
+	static void sleepUntil(const struct timespec &deadline);
+	static bool timeReached(const struct timespec &now, const struct timespec &t);
 	virtual void setResolution(int res);
-	virtual int savePosition(int pos);
-	virtual bool readDS18B20();
+	bool openPositionStore(int &pos);
+	void closePositionStore();
+	bool savePosition(int pos, bool moving = false);
+	void checkpointPosition();
+	void findDS18B20();
+	bool readDS18B20(int &fd, int &temperature);
+	void convertDS18B20(const std::vector<std::string> &masters, int conversionTime);
+	int setDS18B20Resolution(const std::string &sensorDir, int bits);
 	void getFocuserInfo();
+	void changeResolution(int new_resolution);
+	void autoResolution();
 	int stepperStandbyID { -1 };
 	void stepperStandby();
-	int updateTemperatureID { -1 };
-	void updateTemperature();
-	int temperatureCompensationID { -1 };
+	bool startTemperatureSampler();
+	void stopTemperatureSampler();
+	void temperatureLoop();
+	void temperatureEvent();
+	void filterTemperature();
+	void temperatureWatchEvent();
 	void temperatureCompensation();
+	void scheduleTemperature(float deltaTemperature, float thermalExpansionRatio);
+	double temperatureRate();
+	int compensationDeadlineID { -1 };
+	void compensationDeadline();
+	void exposureEvent(bool active);
+	void recordHistory(uint16_t type, int adjustment);
+	void sendHistory();
+	int autofocusSettledID { -1 };
+	void autofocusSettled();
+	void recordFocus();
+	bool learnedSlope(double &slope);
+	void updateLearnedModel();
+	bool startStepper();
+	void stopStepper();
+	void stepperLoop();
+	struct MotionProfile;
+	struct StepperCommand;
+	void planMove(MotionProfile &profile, int steps);
+	void stepperMove();
+	void stepperNotify();
+	void stepperEvent();
+	void resetStepTiming();
+	void updateStepTiming();
 
-	ISwitch FocusResolutionS[6];
+	ISwitch FocusResolutionS[7];
 	ISwitchVectorProperty FocusResolutionSP;
 	ISwitch MotorBoardS[2];
 	ISwitchVectorProperty MotorBoardSP;
@@ -72,12 +122,28 @@ private:
 	ISwitchVectorProperty StepperStandbySP;
 	INumber FocuserInfoN[3];
 	INumberVectorProperty FocuserInfoNP;
+	INumber AutoResolutionN[1];
+	INumberVectorProperty AutoResolutionNP;
 	INumber BCMpinsN[6];
 	INumberVectorProperty BCMpinsNP;
 	INumber StepperStandbyTimeN[1];
 	INumberVectorProperty StepperStandbyTimeNP;	
 	INumber FocusStepDelayN[1];
 	INumberVectorProperty FocusStepDelayNP;
+	INumber MotionProfileN[2];
+	INumberVectorProperty MotionProfileNP;
+	INumber PositionUpdateRateN[1];
+	INumberVectorProperty PositionUpdateRateNP;
+	ISwitch CoarseSteppingS[5];
+	ISwitchVectorProperty CoarseSteppingSP;
+	INumber FineApproachN[1];
+	INumberVectorProperty FineApproachNP;
+	INumber PositionCheckpointN[1];
+	INumberVectorProperty PositionCheckpointNP;
+	INumber StepTimingN[10];
+	INumberVectorProperty StepTimingNP;
+	ISwitch StepTimingResetS[1];
+	ISwitchVectorProperty StepTimingResetSP;
 	INumber FocuserTravelN[1];
 	INumberVectorProperty FocuserTravelNP;
 	INumber ScopeParametersN[2];
@@ -86,7 +152,36 @@ private:
 	INumberVectorProperty FocusTemperatureNP;
 	INumber TemperatureCoefN[1];
 	INumberVectorProperty TemperatureCoefNP;
-	IText ActiveTelescopeT[1];
+	ISwitch TemperatureResolutionS[4];
+	ISwitchVectorProperty TemperatureResolutionSP;
+	enum { SENSOR_TUBE, SENSOR_AMBIENT, SENSOR_MIRROR, SENSOR_COUNT };
+	IText TemperatureSensorsT[SENSOR_COUNT];
+	ITextVectorProperty TemperatureSensorsTP;
+	INumber TemperatureSensorsN[SENSOR_COUNT];
+	INumberVectorProperty TemperatureSensorsNP;
+	ISwitch TemperatureSourceS[SENSOR_COUNT];
+	ISwitchVectorProperty TemperatureSourceSP;
+	INumber TemperatureFilterN[2];
+	INumberVectorProperty TemperatureFilterNP;
+	INumber FilteredTemperatureN[1];
+	INumberVectorProperty FilteredTemperatureNP;
+	ISwitch TemperatureModelS[2];
+	ISwitchVectorProperty TemperatureModelSP;
+	ISwitch FocusLearningS[2];
+	ISwitchVectorProperty FocusLearningSP;
+	ISwitch AutoRecordS[2];
+	ISwitchVectorProperty AutoRecordSP;
+	INumber LearningDataN[5];
+	INumberVectorProperty LearningDataNP;
+	INumber LearnedModelN[2];
+	INumberVectorProperty LearnedModelNP;
+	INumber CompensationDeadlineN[1];
+	INumberVectorProperty CompensationDeadlineNP;
+	ISwitch TemperatureHistoryS[1];
+	ISwitchVectorProperty TemperatureHistorySP;
+	IBLOB TemperatureHistoryB[1];
+	IBLOBVectorProperty TemperatureHistoryBP;
+	IText ActiveTelescopeT[2];
 	ITextVectorProperty ActiveTelescopeTP;
 
 	struct gpiod_chip *chip;
@@ -97,12 +192,144 @@ private:
 	struct gpiod_line *gpio_m2;
 	struct gpiod_line *gpio_m3;
 
-	int backlashTicksRemaining;
-	int focuserTicksRemaining;
-	int stepperDirection = 1;
+	// dir and mode lines requested together, M1 and M3 are included for A4988 only
+	enum { CONTROL_DIR, CONTROL_M2, CONTROL_M1, CONTROL_M3 };
+	struct gpiod_line_bulk gpio_control;
+	int controlValues[4];
+	bool m1Floating = false;
+	std::mutex controlMutex; // guards writes of control lines
+
+	// motion planner output, step intervals in microseconds
+	struct MotionProfile
+	{
+		std::shared_ptr<const std::vector<uint32_t>> ramp; // intervals at each speed level while accelerating or decelerating, shared by moves
+		uint32_t cruise; // interval of cruising steps
+		double duration; // planned move duration in seconds
+
+		size_t rampSize() const
+		{
+			return ramp ? ramp->size() : 0;
+		}
+
+		uint32_t interval(unsigned int level) const
+		{
+			return level < rampSize() ? (*ramp)[level] : cruise;
+		}
+
+		// interval of the next step with toGo steps left, updates speed level
+		uint32_t next(unsigned int &level, int toGo) const
+		{
+			if (toGo <= (int) level) // decelerate to stop at target, or before reversing
+				return interval(level > 0 ? --level : 0);
+			if (level < rampSize() && toGo >= (int) level + 2) // accelerate
+				return interval(level++);
+			return interval(level); // cruise
+		}
+	};
+
+	// stepping engine mailbox, all members below guarded by stepperMutex
+	// target, backlash and fine approach are in MAX_RESOLUTION microsteps
+	struct StepperCommand
+	{
+		int target;
+		int backlash;
+		bool reverse;
+		int resolution; // focuser resolution, used for backlash and final approach
+		int coarse; // resolution of the bulk of the move
+		int fineApproach;
+		uint32_t updateInterval; // position reporting interval in microseconds
+		MotionProfile profile;
+	};
+	MotionProfile plannedRamp; // ramp of current speed settings, reused until they change
+	double plannedSettings[3] = { 0, 0, 0 }; // start speed, cruise speed and acceleration of plannedRamp
+	int plannedDirection = 1; // direction of last planned move, moves end in it
+	std::thread stepperThread;
+	std::mutex stepperMutex;
+	std::condition_variable stepperCondition;
+	StepperCommand stepperCommand;
+	std::atomic<bool> stepperCommandPending { false }; // also polled by the engine between steps
+	bool stepperExit = false;
+
+	// stepping engine state shared with the main loop
+	std::atomic<bool> stepperBusy { false };
+	std::atomic<bool> stepperAbort { false };
+	std::atomic<int> stepperPosition { 0 }; // MAX_RESOLUTION microsteps
+	int stepperEventFD { -1 };
+	int stepperEventID { -1 };
+	bool stepperMoving = false; // main loop view of the move in progress
+	int stepperTarget = 0; // last target sent to stepping engine
+
+	int stepperDirection = 1; // owned by stepping engine
+	int stepperPhase = 0; // driver indexer position in MAX_RESOLUTION microsteps, owned by stepping engine while moving
+
+	// step timing diagnostics, updated by stepping engine without locking
+	std::atomic<uint32_t> stepLatency[8]; // histogram of step latency
+	std::atomic<uint32_t> stepOverruns; // schedule restarts after running late by more than a step
+	std::atomic<uint32_t> stepLatencyMax; // microseconds
 	
+	// position store, two journaled records written in turns
+	int positionFD { -1 };
+	char positionFileName[MAXRBUF];
+	uint32_t positionSequence = 0;
+	int savedPosition = 0;
+	bool savedMoving = false;
+	struct timespec positionCheckpoint;
+
+	// temperature sampler, latest samples are handed over as sequence number and temperature packed together
+	std::vector<std::string> temperatureSensorsFound;
+	int temperatureWatchFD { -1 }; // inotify watch of 1-Wire devices
+	int temperatureWatchID { -1 };
+	std::atomic<int> temperatureResolution { 12 }; // requested conversion resolution in bits
+	std::atomic<int> temperatureResolutionApplied { 0 }; // reported by sensors, 0 if unknown or different
+	std::thread temperatureThread;
+	std::mutex temperatureMutex;
+	std::condition_variable temperatureCondition;
+	bool temperatureExit = false; // guarded by temperatureMutex
+	bool temperatureConfigChanged = false; // guarded by temperatureMutex
+	std::string temperatureSensorDirs[SENSOR_COUNT]; // guarded by temperatureMutex
+	std::vector<std::string> temperatureMasters; // therm_bulk_read of bus masters, guarded by temperatureMutex
+	std::atomic<uint64_t> temperatureSamples[SENSOR_COUNT];
+	std::atomic<int> temperatureInterval { 0 }; // next sample in milliseconds set by compensation, sample period if 0
+	bool temperatureScheduleChanged = false; // guarded by temperatureMutex
+	int temperatureEventFD { -1 };
+	int temperatureEventID { -1 };
+	uint32_t temperatureSequence = 0; // last sample seen by main loop
+	bool temperatureReady = false; // valid temperature received
+
 	int resolution = 1;
+	int pendingResolution = 0; // resolution to set when focuser stops
 	float lastTemperature;
+	bool compensationMove = false; // move in progress was not requested by client, e.g. temperature compensation
+	int autofocusMoves = 0; // client moves since focuser last settled
+	bool learningDataLoading = false; // learning data is read only, set from config only
+	bool exposureActive = false; // snooped camera is exposing
+	bool compensationDeferred = false; // compensation move waits for end of exposure
+	bool compensationOverdue = false; // deferral deadline passed, move regardless of exposure
+
+	// compensation input, median of last three samples smoothed by exponential moving average
+	float temperatureRing[3];
+	int temperatureRingCount = 0;
+	float filteredTemperature;
+
+	// recent filtered samples for temperature rate
+	struct TemperaturePoint { double time; float temperature; };
+	TemperaturePoint temperatureHistory[10];
+	int temperatureHistoryCount = 0;
+
+	// session history of temperature samples and compensation moves
+	// sent to clients as 16 byte little endian records in the field order below, positions in steps at current resolution
+	enum { HISTORY_SAMPLE, HISTORY_MOVE };
+	struct HistoryRecord
+	{
+		uint32_t time; // unix time in seconds
+		int16_t temperature; // filtered temperature in 1/100 °C
+		uint16_t type; // HISTORY_SAMPLE or HISTORY_MOVE
+		int32_t position; // focuser position in MAX_RESOLUTION microsteps
+		int32_t adjustment; // compensation move in MAX_RESOLUTION microsteps
+	};
+	HistoryRecord history[4096];
+	uint32_t historyCount = 0;
+	std::vector<uint8_t> historyBlob;
 };
 
 #endif
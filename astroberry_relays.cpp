@@ -17,8 +17,14 @@
 *******************************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <memory>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
 #include "config.h"
 
 #include "astroberry_relays.h"
@@ -85,50 +91,109 @@ IndiAstroberryRelays::IndiAstroberryRelays()
 IndiAstroberryRelays::~IndiAstroberryRelays()
 {
 	// Delete controls on options tab
+	deleteProperty(RelayCountNP.name);
+	deleteProperty(PollingNP.name);
+	deleteProperty(GPIOChipsNP.name);
 	deleteProperty(BCMpinsNP.name);
 	deleteProperty(ActiveStateSP.name);
 	deleteProperty(RelayLabelsTP.name);
+	deleteProperty(RelayGroupsTP.name);
 }
 bool IndiAstroberryRelays::Connect()
 {
-	// Init GPIO
-	chip = gpiod_chip_open(gpio_chip_path);
-	if (!chip)
+	// verify GPIO lines are set and unique on each chip, pins and chips are both loaded by now
+	for (int relay = 0; relay < relayCount; relay++)
 	{
-		DEBUG(INDI::Logger::DBG_SESSION, "Problem initiating Astroberry Relays.");
-		return false;
+		if ( BCMpinsN[relay].value < 0 )
+		{
+			DEBUGF(INDI::Logger::DBG_ERROR, "GPIO line of Relay %d not set", relay + 1);
+			BCMpinsNP.s = IPS_ALERT;
+			IDSetNumber(&BCMpinsNP, nullptr);
+			return false;
+		}
+
+		for (int other = relay + 1; other < relayCount; other++)
+		{
+			if ( BCMpinsN[relay].value == BCMpinsN[other].value && GPIOChipsN[relay].value == GPIOChipsN[other].value )
+			{
+				DEBUGF(INDI::Logger::DBG_ERROR, "Relay %d and Relay %d use the same GPIO line %0.0f of /dev/gpiochip%0.0f", relay + 1, other + 1, BCMpinsN[relay].value, GPIOChipsN[relay].value);
+				BCMpinsNP.s = IPS_ALERT;
+				IDSetNumber(&BCMpinsNP, nullptr);
+				return false;
+			}
+		}
 	}
 
-	// verify BCM Pins are not used by other consumers
-	for (unsigned int pin = 0; pin < 8; pin++)
+	// Group relays by gpiochip, each chip gets one request
+	relayChips.clear();
+	std::vector<int> chipNumbers;
+	for (int relay = 0; relay < relayCount; relay++)
 	{
-		if (gpiod_line_is_used(gpiod_chip_get_line(chip, BCMpinsN[pin].value)))
+		int number = GPIOChipsN[relay].value;
+		size_t index = std::find(chipNumbers.begin(), chipNumbers.end(), number) - chipNumbers.begin();
+		if (index == chipNumbers.size())
 		{
-			DEBUGF(INDI::Logger::DBG_ERROR, "BCM Pin %0.0f already used", BCMpinsN[pin].value);
-			gpiod_chip_close(chip);
+			// Init GPIO
+			RelayChip relayChip;
+			relayChip.chip = gpiod_chip_open_by_number(number);
+			if (!relayChip.chip)
+			{
+				DEBUGF(INDI::Logger::DBG_ERROR, "Problem opening /dev/gpiochip%d for Astroberry Relays.", number);
+				closeRelayChips();
+				return false;
+			}
+			gpiod_line_bulk_init(&relayChip.lines);
+			relayChip.mask = 0;
+			relayChip.watchFD = -1;
+			relayChip.watchID = -1;
+			relayChips.push_back(relayChip);
+			chipNumbers.push_back(number);
+		}
+
+		RelayChip &relayChip = relayChips[index];
+
+		// verify GPIO line exists and is not used by other consumers
+		struct gpiod_line *line = gpiod_chip_get_line(relayChip.chip, BCMpinsN[relay].value);
+		if (!line || gpiod_line_is_used(line))
+		{
+			DEBUGF(INDI::Logger::DBG_ERROR, "GPIO line %0.0f of /dev/gpiochip%d not available", BCMpinsN[relay].value, number);
+			BCMpinsNP.s = IPS_ALERT;
+			IDSetNumber(&BCMpinsNP, nullptr);
+			closeRelayChips();
 			return false;
 		}
-	}
 
-	// Select gpios
-	gpio_relay1 = gpiod_chip_get_line(chip, BCMpinsN[0].value);
-	gpio_relay2 = gpiod_chip_get_line(chip, BCMpinsN[1].value);
-	gpio_relay3 = gpiod_chip_get_line(chip, BCMpinsN[2].value);
-	gpio_relay4 = gpiod_chip_get_line(chip, BCMpinsN[3].value);
-	gpio_relay5 = gpiod_chip_get_line(chip, BCMpinsN[4].value);
-	gpio_relay6 = gpiod_chip_get_line(chip, BCMpinsN[5].value);
-	gpio_relay7 = gpiod_chip_get_line(chip, BCMpinsN[6].value);
-	gpio_relay8 = gpiod_chip_get_line(chip, BCMpinsN[7].value);
+		relayChip.relays[gpiod_line_bulk_num_lines(&relayChip.lines)] = relay;
+		gpiod_line_bulk_add(&relayChip.lines, line);
+		relayChip.mask |= 1ULL << relay;
+	}
 
 	// Set initial gpios direction and states
-	gpiod_line_request_output(gpio_relay1, "1@astroberry_relays", relayState[0]);
-	gpiod_line_request_output(gpio_relay2, "2@astroberry_relays", relayState[1]);
-	gpiod_line_request_output(gpio_relay3, "3@astroberry_relays", relayState[2]);
-	gpiod_line_request_output(gpio_relay4, "4@astroberry_relays", relayState[3]);
-	gpiod_line_request_output(gpio_relay5, "5@astroberry_relays", relayState[4]);
-	gpiod_line_request_output(gpio_relay6, "6@astroberry_relays", relayState[5]);
-	gpiod_line_request_output(gpio_relay7, "7@astroberry_relays", relayState[6]);
-	gpiod_line_request_output(gpio_relay8, "8@astroberry_relays", relayState[7]);
+	for (auto &relayChip : relayChips)
+	{
+		int values[MAX_RELAYS];
+		unsigned int count = gpiod_line_bulk_num_lines(&relayChip.lines);
+		for (unsigned int i = 0; i < count; i++)
+			values[i] = relayState >> relayChip.relays[i] & 1 ? activeState : !activeState;
+
+		if (gpiod_line_request_bulk_output(&relayChip.lines, "astroberry_relays", values) < 0)
+		{
+			DEBUGF(INDI::Logger::DBG_ERROR, "Problem requesting Astroberry Relays GPIO lines of %s.", gpiod_chip_name(relayChip.chip));
+			closeRelayChips();
+			return false;
+		}
+
+		// our writes are tracked in relayState, only other consumers changing lines need to be noticed
+		watchRelayChip(relayChip);
+	}
+
+	// Lock Relay Count setting
+	RelayCountNP.s = IPS_BUSY;
+	IDSetNumber(&RelayCountNP, nullptr);
+
+	// Lock GPIO Chips setting
+	GPIOChipsNP.s = IPS_BUSY;
+	IDSetNumber(&GPIOChipsNP, nullptr);
 
 	// Lock BCM Pins setting
 	BCMpinsNP.s = IPS_BUSY;
@@ -142,17 +207,34 @@ bool IndiAstroberryRelays::Connect()
 	RelayLabelsTP.s = IPS_BUSY;
 	IDSetText(&RelayLabelsTP, nullptr);
 
-	// Set polling timer
-	SetTimer(pollingTime);
+	// Lock Relay Groups setting
+	RelayGroupsTP.s = IPS_BUSY;
+	IDSetText(&RelayGroupsTP, nullptr);
+
+	// Set consistency check timer
+	if (PollingN[0].value > 0)
+		pollingTimerID = SetTimer(PollingN[0].value * 1000);
 
-	DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays connected successfully.");
+	DEBUGF(INDI::Logger::DBG_SESSION, "Astroberry Relays connected successfully with %d relays on %d GPIO chips.", relayCount, (int) relayChips.size());
 
 	return true;
 }
 bool IndiAstroberryRelays::Disconnect()
 {
+	// Stop consistency check
+	RemoveTimer(pollingTimerID);
+	pollingTimerID = -1;
+
 	// Close GPIO
-	gpiod_chip_close(chip);
+	closeRelayChips();
+
+	// Unlock Relay Count setting
+	RelayCountNP.s = IPS_IDLE;
+	IDSetNumber(&RelayCountNP, nullptr);
+
+	// Unlock GPIO Chips setting
+	GPIOChipsNP.s=IPS_IDLE;
+	IDSetNumber(&GPIOChipsNP, nullptr);
 
 	// Unlock BCM Pins setting
 	BCMpinsNP.s=IPS_IDLE;
@@ -166,6 +248,10 @@ bool IndiAstroberryRelays::Disconnect()
 	RelayLabelsTP.s = IPS_IDLE;
 	IDSetText(&RelayLabelsTP, nullptr);
 
+	// Unlock Relay Groups setting
+	RelayGroupsTP.s = IPS_IDLE;
+	IDSetText(&RelayGroupsTP, nullptr);
+
 	DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays disconnected successfully.");
 	return true;
 }
@@ -178,25 +264,38 @@ bool IndiAstroberryRelays::initProperties()
 	// We init parent properties first
 	INDI::DefaultDevice::initProperties();
 
-	IUFillNumber(&BCMpinsN[0], "BCMPIN01", "Relay 1", "%0.0f", 1, 27, 0, 5); // BCM5 = PIN29
-	IUFillNumber(&BCMpinsN[1], "BCMPIN02", "Relay 2", "%0.0f", 1, 27, 0, 6); // BCM6 = PIN31
-	IUFillNumber(&BCMpinsN[2], "BCMPIN03", "Relay 3", "%0.0f", 1, 27, 0, 13); // BCM13 = PIN33
-	IUFillNumber(&BCMpinsN[3], "BCMPIN04", "Relay 4", "%0.0f", 1, 27, 0, 16); // BCM16 = PIN36
-	IUFillNumber(&BCMpinsN[4], "BCMPIN05", "Relay 5", "%0.0f", 1, 27, 0, 19); // BCM19 = PIN35
-	IUFillNumber(&BCMpinsN[5], "BCMPIN06", "Relay 6", "%0.0f", 1, 27, 0, 20); // BCM20 = PIN38
-	IUFillNumber(&BCMpinsN[6], "BCMPIN07", "Relay 7", "%0.0f", 1, 27, 0, 21); // BCM21 = PIN40
-	IUFillNumber(&BCMpinsN[7], "BCMPIN08", "Relay 8", "%0.0f", 1, 27, 0, 26); // BCM26 = PIN37
-	IUFillNumberVector(&BCMpinsNP, BCMpinsN, 8, getDeviceName(), "BCMPINS", "BCM Pins", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
-
-	IUFillText(&RelayLabelsT[0], "RELAYLABEL01", "Relay 1", "Relay 1");
-	IUFillText(&RelayLabelsT[1], "RELAYLABEL02", "Relay 2", "Relay 2");
-	IUFillText(&RelayLabelsT[2], "RELAYLABEL03", "Relay 3", "Relay 3");
-	IUFillText(&RelayLabelsT[3], "RELAYLABEL04", "Relay 4", "Relay 4");
-	IUFillText(&RelayLabelsT[4], "RELAYLABEL05", "Relay 5", "Relay 5");
-	IUFillText(&RelayLabelsT[5], "RELAYLABEL06", "Relay 6", "Relay 6");
-	IUFillText(&RelayLabelsT[6], "RELAYLABEL07", "Relay 7", "Relay 7");
-	IUFillText(&RelayLabelsT[7], "RELAYLABEL08", "Relay 8", "Relay 8");
-	IUFillTextVector(&RelayLabelsTP, RelayLabelsT, 8, getDeviceName(), "RELAYLABELS", "Relay Labels", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+	IUFillNumber(&RelayCountN[0], "RELAYCOUNT", "Relays", "%0.0f", 1, MAX_RELAYS, 1, 8);
+	IUFillNumberVector(&RelayCountNP, RelayCountN, 1, getDeviceName(), "RELAYCOUNT", "Relay Count", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// line info watch only reports chip loss and line (re)configuration, relay values set outside the driver are found by this check
+	IUFillNumber(&PollingN[0], "POLLINGINTERVAL", "Interval (s)", "%0.0f", 0, 3600, 1, 10);
+	IUFillNumberVector(&PollingNP, PollingN, 1, getDeviceName(), "RELAYPOLLING", "Status Check", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+
+	// Default pins of Waveshare RPi Relay Board (B), other relays need GPIO lines set
+	// Relays on other gpiochips (e.g. I2C expanders) use line offsets of their chip instead of BCM Pins
+	const int defaultPins[8] = { 5, 6, 13, 16, 19, 20, 21, 26 }; // PIN29, PIN31, PIN33, PIN36, PIN35, PIN38, PIN40, PIN37
+	for (int relay = 0; relay < MAX_RELAYS; relay++)
+	{
+		char name[MAXINDINAME], label[MAXINDILABEL];
+		snprintf(label, MAXINDILABEL, "Relay %d", relay + 1);
+		snprintf(name, MAXINDINAME, "BCMPIN%02d", relay + 1);
+		IUFillNumber(&BCMpinsN[relay], name, label, "%0.0f", -1, 255, 0, relay < 8 ? defaultPins[relay] : -1);
+		snprintf(name, MAXINDINAME, "GPIOCHIP%02d", relay + 1);
+		IUFillNumber(&GPIOChipsN[relay], name, label, "%0.0f", 0, 63, 0, 0);
+		snprintf(name, MAXINDINAME, "RELAYLABEL%02d", relay + 1);
+		IUFillText(&RelayLabelsT[relay], name, label, label);
+	}
+	fillRelayOptions();
+
+	// Relay groups defined as "name: relay, relay, ..."
+	for (int group = 0; group < MAX_RELAY_GROUPS; group++)
+	{
+		char name[MAXINDINAME], label[MAXINDILABEL];
+		snprintf(name, MAXINDINAME, "RELAYGROUP%02d", group + 1);
+		snprintf(label, MAXINDILABEL, "Group %d", group + 1);
+		IUFillText(&RelayGroupsT[group], name, label, "");
+	}
+	IUFillTextVector(&RelayGroupsTP, RelayGroupsT, MAX_RELAY_GROUPS, getDeviceName(), "RELAYGROUPS", "Relay Groups", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
 
 	IUFillSwitch(&ActiveStateS[0], "ACTIVELO", "Low", ISS_ON);
 	IUFillSwitch(&ActiveStateS[1], "ACTIVEHI", "High", ISS_OFF);
@@ -204,67 +303,38 @@ bool IndiAstroberryRelays::initProperties()
 
 	// Load options before connecting
 	// load config before defining switches
+	defineNumber(&RelayCountNP);
+	defineNumber(&PollingNP);
+	defineNumber(&GPIOChipsNP);
 	defineNumber(&BCMpinsNP);
 	defineSwitch(&ActiveStateSP);
 	defineText(&RelayLabelsTP);
+	defineText(&RelayGroupsTP);
 	loadConfig();
 
-	IUFillSwitch(&Switch1S[0], "SW1ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch1S[1], "SW1OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch1SP, Switch1S, 2, getDeviceName(), "SWITCH_1", RelayLabelsT[0].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch2S[0], "SW2ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch2S[1], "SW2OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch2SP, Switch2S, 2, getDeviceName(), "SWITCH_2", RelayLabelsT[1].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch3S[0], "SW3ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch3S[1], "SW3OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch3SP, Switch3S, 2, getDeviceName(), "SWITCH_3", RelayLabelsT[2].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch4S[0], "SW4ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch4S[1], "SW4OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch4SP, Switch4S, 2, getDeviceName(), "SWITCH_4", RelayLabelsT[3].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch5S[0], "SW5ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch5S[1], "SW5OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch5SP, Switch5S, 2, getDeviceName(), "SWITCH_5", RelayLabelsT[4].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch6S[0], "SW6ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch6S[1], "SW6OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch6SP, Switch6S, 2, getDeviceName(), "SWITCH_6", RelayLabelsT[5].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch7S[0], "SW7ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch7S[1], "SW7OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch7SP, Switch7S, 2, getDeviceName(), "SWITCH_7", RelayLabelsT[6].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-
-	IUFillSwitch(&Switch8S[0], "SW8ON", "ON", ISS_OFF);
-	IUFillSwitch(&Switch8S[1], "SW8OFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&Switch8SP, Switch8S, 2, getDeviceName(), "SWITCH_8", RelayLabelsT[7].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-	/*
-	IUFillSwitch(&MasterSwitchS[0], "MASTERSWON", "ON", ISS_OFF);
-	IUFillSwitch(&MasterSwitchS[1], "MASTERSWOFF", "OFF", ISS_ON);
-	IUFillSwitchVector(&MasterSwitchSP, MasterSwitchS, 2, getDeviceName(), "MASTER_SWITCH", "ALL RELAYS", MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
-	*/
-
-	/*
-    IUFillLight(&SwitchStatusL[0], RelayLabelsT[0].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[1], RelayLabelsT[1].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[2], RelayLabelsT[2].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[3], RelayLabelsT[3].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[4], RelayLabelsT[4].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[5], RelayLabelsT[5].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[6], RelayLabelsT[6].text, "", IPS_IDLE);
-    IUFillLight(&SwitchStatusL[7], RelayLabelsT[7].text, "", IPS_IDLE);
-    IUFillLightVector(&SwitchStatusLP, SwitchStatusL, 8, getDeviceName(), "Status", "", MAIN_CONTROL_TAB, IPS_IDLE);
-	*/
+	for (int relay = 0; relay < MAX_RELAYS; relay++)
+	{
+		char name[MAXINDINAME];
+		snprintf(name, MAXINDINAME, "SW%dON", relay + 1);
+		IUFillSwitch(&relays[relay].SwitchS[0], name, "ON", ISS_OFF);
+		snprintf(name, MAXINDINAME, "SW%dOFF", relay + 1);
+		IUFillSwitch(&relays[relay].SwitchS[1], name, "OFF", ISS_ON);
+		snprintf(name, MAXINDINAME, "SWITCH_%d", relay + 1);
+		IUFillSwitchVector(&relays[relay].SwitchSP, relays[relay].SwitchS, 2, getDeviceName(), name, RelayLabelsT[relay].text, MAIN_CONTROL_TAB, IP_RW, ISR_1OFMANY, 0, IPS_IDLE);
+	}
 
 	// Set initial relays states to OFF
-	for (int i=0; i < 8; i++) {
-		relayState[i] = !activeState;
-	}
+	relayState = 0;
 
 	return true;
 }
+void IndiAstroberryRelays::fillRelayOptions()
+{
+	// options vectors cover configured relays only
+	IUFillNumberVector(&GPIOChipsNP, GPIOChipsN, relayCount, getDeviceName(), "GPIOCHIPS", "GPIO Chips", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+	IUFillNumberVector(&BCMpinsNP, BCMpinsN, relayCount, getDeviceName(), "BCMPINS", "BCM Pins", OPTIONS_TAB, IP_RW, 0, IPS_IDLE);
+	IUFillTextVector(&RelayLabelsTP, RelayLabelsT, relayCount, getDeviceName(), "RELAYLABELS", "Relay Labels", OPTIONS_TAB, IP_RW, 60, IPS_IDLE);
+}
 bool IndiAstroberryRelays::updateProperties()
 {
 	// Call parent update properties first
@@ -273,30 +343,20 @@ bool IndiAstroberryRelays::updateProperties()
 	if (isConnected())
 	{
 		// We're connected
-		defineSwitch(&Switch1SP);
-		defineSwitch(&Switch2SP);
-		defineSwitch(&Switch3SP);
-		defineSwitch(&Switch4SP);
-		defineSwitch(&Switch5SP);
-		defineSwitch(&Switch6SP);
-		defineSwitch(&Switch7SP);
-		defineSwitch(&Switch8SP);
-		//defineSwitch(&MasterSwitchSP);
-		//defineLight(&SwitchStatusLP);
+		for (int relay = 0; relay < relayCount; relay++)
+			defineSwitch(&relays[relay].SwitchSP);
+		fillRelayGroups();
+		for (int group = 0; group < groupCount; group++)
+			defineSwitch(&groups[group].SwitchSP);
+		updateGroupSwitches();
 	}
 	else
 	{
 		// We're disconnected
-		deleteProperty(Switch1SP.name);
-		deleteProperty(Switch2SP.name);
-		deleteProperty(Switch3SP.name);
-		deleteProperty(Switch4SP.name);
-		deleteProperty(Switch5SP.name);
-		deleteProperty(Switch6SP.name);
-		deleteProperty(Switch7SP.name);
-		deleteProperty(Switch8SP.name);
-		//deleteProperty(MasterSwitchSP.name);
-		//deleteProperty(SwitchStatusLP.name);
+		for (int relay = 0; relay < relayCount; relay++)
+			deleteProperty(relays[relay].SwitchSP.name);
+		for (int group = 0; group < groupCount; group++)
+			deleteProperty(groups[group].SwitchSP.name);
 	}
 	return true;
 }
@@ -311,65 +371,92 @@ bool IndiAstroberryRelays::ISNewNumber (const char *dev, const char *name, doubl
 	// first we check if it's for our device
 	if(strcmp(dev,getDeviceName())==0)
 	{
+		// handle relay count
+		if (!strcmp(name, RelayCountNP.name))
+		{
+			if (isConnected())
+			{
+				DEBUG(INDI::Logger::DBG_WARNING, "Cannot set Relay Count while device is connected.");
+				return false;
+			}
+
+			IUUpdateNumber(&RelayCountNP,values,names,n);
+			relayCount = RelayCountN[0].value;
+
+			// redefine options for new number of relays
+			deleteProperty(GPIOChipsNP.name);
+			deleteProperty(BCMpinsNP.name);
+			deleteProperty(RelayLabelsTP.name);
+			fillRelayOptions();
+			defineNumber(&GPIOChipsNP);
+			defineNumber(&BCMpinsNP);
+			defineText(&RelayLabelsTP);
+
+			RelayCountNP.s=IPS_OK;
+			IDSetNumber(&RelayCountNP, nullptr);
+			DEBUGF(INDI::Logger::DBG_SESSION, "Astroberry Relays count set to %d", relayCount);
+			return true;
+		}
+
+		// handle status check interval
+		if (!strcmp(name, PollingNP.name))
+		{
+			IUUpdateNumber(&PollingNP,values,names,n);
+
+			// reschedule consistency check
+			if (isConnected())
+			{
+				RemoveTimer(pollingTimerID);
+				pollingTimerID = -1;
+				if (PollingN[0].value > 0)
+					pollingTimerID = SetTimer(PollingN[0].value * 1000);
+			}
+
+			PollingNP.s=IPS_OK;
+			IDSetNumber(&PollingNP, nullptr);
+			if (PollingN[0].value > 0)
+				DEBUGF(INDI::Logger::DBG_SESSION, "Astroberry Relays status check set to %0.0f seconds", PollingN[0].value);
+			else
+				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays status check disabled");
+			return true;
+		}
+
+		// handle GPIO chips
+		if (!strcmp(name, GPIOChipsNP.name))
+		{
+			if (isConnected())
+			{
+				DEBUG(INDI::Logger::DBG_WARNING, "Cannot set GPIO Chips while device is connected.");
+				return false;
+			}
+
+			// lines are verified when relays connect
+			IUUpdateNumber(&GPIOChipsNP,values,names,n);
+
+			GPIOChipsNP.s=IPS_OK;
+			IDSetNumber(&GPIOChipsNP, nullptr);
+			DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays GPIO Chips set");
+			for (int relay = 0; relay < relayCount; relay++)
+				DEBUGF(INDI::Logger::DBG_DEBUG, "Relay%d: /dev/gpiochip%0.0f", relay + 1, GPIOChipsN[relay].value);
+			return true;
+		}
+
 	        // handle BCMpins
 	        if (!strcmp(name, BCMpinsNP.name))
 	        {
-			unsigned int valcount = 8;
-
 			if (isConnected())
 			{
 				DEBUG(INDI::Logger::DBG_WARNING, "Cannot set BCM Pins while device is connected.");
 				return false;
 			} else {
-				for (unsigned int i = 0; i < valcount; i++)
-				{
-					// verify a number is a valid BCM Pin
-					if ( values[i] < 1 || values[i] > 27 )
-					{
-						BCMpinsNP.s=IPS_ALERT;
-						IDSetNumber(&BCMpinsNP, nullptr);
-						DEBUGF(INDI::Logger::DBG_ERROR, "Value %0.0f is not a valid BCM Pin number!", values[i]);
-						return false;
-					}
-
-					// Verify unique BCM Pin assignement
-					for (unsigned j = i + 1; j < valcount; j++)
-					{
-						if ( values[i] == values[j] )
-						{
-							BCMpinsNP.s=IPS_ALERT;
-							IDSetNumber(&BCMpinsNP, nullptr);
-							DEBUG(INDI::Logger::DBG_ERROR, "You cannot assign the same BCM Pin twice!");
-							return false;
-						}
-					}
-
-					// verify BCM Pins are not used by other consumers
-					chip = gpiod_chip_open("/dev/gpiochip0");
-					if (chip)
-					{
-						struct gpiod_line *line = gpiod_chip_get_line(chip, values[i]);
-						bool line_status = gpiod_line_is_used(line);
-						gpiod_chip_close(chip);
-
-						if (line_status)
-						{
-							BCMpinsNP.s=IPS_ALERT;
-							IDSetNumber(&BCMpinsNP, nullptr);
-							DEBUGF(INDI::Logger::DBG_ERROR, "BCM Pin %0.0f already used!", values[i]);
-							return false;
-						}
-					} else {
-						DEBUG(INDI::Logger::DBG_ERROR, "Problem initiating Astroberry Relays.");
-						return false;
-					}
-				}
-
+				// lines depend on GPIO Chips and are verified when relays connect
 				IUUpdateNumber(&BCMpinsNP,values,names,n);
 
 				BCMpinsNP.s=IPS_OK;
 				IDSetNumber(&BCMpinsNP, nullptr);
-				DEBUGF(INDI::Logger::DBG_SESSION, "Astroberry Relays BCM Pins set to Relay1: %0.0f, Relay2: %0.0f, Relay3: %0.0f, Relay4: %0.0f, Relay5: %0.0f, Relay6: %0.0f, Relay7: %0.0f, Relay8: %0.0f", BCMpinsN[0].value, BCMpinsN[1].value, BCMpinsN[2].value, BCMpinsN[3].value, BCMpinsN[4].value, BCMpinsN[5].value, BCMpinsN[6].value, BCMpinsN[7].value);
+				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays BCM Pins set");
+				for (int relay = 0; relay < relayCount; relay++)
+					DEBUGF(INDI::Logger::DBG_DEBUG, "Relay%d: %0.0f", relay + 1, BCMpinsN[relay].value);
 				return true;
 			}
         	}
@@ -379,9 +466,6 @@ bool IndiAstroberryRelays::ISNewNumber (const char *dev, const char *name, doubl
 }
 bool IndiAstroberryRelays::ISNewSwitch (const char *dev, const char *name, ISState *states, char *names[], int n)
 {
-	// return value for relays setting
-	int rv;
-
 	// first we check if it's for our device
 	if (!strcmp(dev, getDeviceName()))
 	{
@@ -416,664 +500,77 @@ bool IndiAstroberryRelays::ISNewSwitch (const char *dev, const char *name, ISSta
 			}
 		}
 
-		// handle relay 1
-		if (!strcmp(name, Switch1SP.name))
-		{
-			IUUpdateSwitch(&Switch1SP, states, names, n);
-
-			if ( Switch1S[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay1, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #1");
-					Switch1SP.s = IPS_ALERT;
-					Switch1S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch1SP, NULL);
-					return false;
-				}
-				relayState[0] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #1 set to ON");
-				Switch1SP.s = IPS_OK;
-				Switch1S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch1SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch1S[1].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay1, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #1");
-					Switch1SP.s = IPS_ALERT;
-					Switch1S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch1SP, NULL);
-					return false;
-				}
-				relayState[0] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #1 set to OFF");
-				Switch1SP.s = IPS_IDLE;
-				Switch1S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch1SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-		}
-
-		// handle relay 2
-		if (!strcmp(name, Switch2SP.name))
-		{
-			IUUpdateSwitch(&Switch2SP, states, names, n);
-
-			if ( Switch2S[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay2, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #2");
-					Switch2SP.s = IPS_ALERT;
-					Switch2S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch2SP, NULL);
-					return false;
-				}
-				relayState[1] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #2 set to ON");
-				Switch2SP.s = IPS_OK;
-				Switch2S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch2SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch2S[1].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay2, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #2");
-					Switch2SP.s = IPS_ALERT;
-					Switch2S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch2SP, NULL);
-					return false;
-				}
-				relayState[1] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #2 set to OFF");
-				Switch2SP.s = IPS_IDLE;
-				Switch2S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch2SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-		}
-
-		// handle relay 3
-		if (!strcmp(name, Switch3SP.name))
+		// handle relays
+		for (int relay = 0; relay < relayCount; relay++)
 		{
-			IUUpdateSwitch(&Switch3SP, states, names, n);
-
-			if ( Switch3S[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay3, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #3");
-					Switch3SP.s = IPS_ALERT;
-					Switch3S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch3SP, NULL);
-					return false;
-				}
-				relayState[2] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #3 set to ON");
-				Switch3SP.s = IPS_OK;
-				Switch3S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch3SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch3S[1].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay3, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #3");
-					Switch3SP.s = IPS_ALERT;
-					Switch3S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch3SP, NULL);
-					return false;
-				}
-				relayState[2] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #3 set to OFF");
-				Switch3SP.s = IPS_IDLE;
-				Switch3S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch3SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-		}
+			ISwitchVectorProperty *svp = &relays[relay].SwitchSP;
+			if (strcmp(name, svp->name))
+				continue;
 
-		// handle relay 4
-		if (!strcmp(name, Switch4SP.name))
-		{
-			IUUpdateSwitch(&Switch4SP, states, names, n);
+			IUUpdateSwitch(svp, states, names, n);
+			bool on = relays[relay].SwitchS[0].s == ISS_ON;
+			uint64_t mask = on ? relayState | 1ULL << relay : relayState & ~(1ULL << relay);
 
-			if ( Switch4S[0].s == ISS_ON )
+			if (writeRelays(mask) != 0)
 			{
-				rv = gpiod_line_set_value(gpio_relay4, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #4");
-					Switch4SP.s = IPS_ALERT;
-					Switch4S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch4SP, NULL);
-					return false;
-				}
-				relayState[3] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #4 set to ON");
-				Switch4SP.s = IPS_OK;
-				Switch4S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch4SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch4S[1].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay4, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #4");
-					Switch4SP.s = IPS_ALERT;
-					Switch4S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch4SP, NULL);
-					return false;
-				}
-				relayState[3] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #4 set to OFF");
-				Switch4SP.s = IPS_IDLE;
-				Switch4S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch4SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
+				DEBUGF(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #%d", relay + 1);
+				svp->s = IPS_ALERT;
+				relays[relay].SwitchS[on ? 0 : 1].s = ISS_OFF;
+				IDSetSwitch(svp, NULL);
+				return false;
 			}
-		}
 
-		// handle relay 5
-		if (!strcmp(name, Switch5SP.name))
-		{
-			IUUpdateSwitch(&Switch5SP, states, names, n);
-
-			if ( Switch5S[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay5, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #5");
-					Switch5SP.s = IPS_ALERT;
-					Switch5S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch5SP, NULL);
-					return false;
-				}
-				relayState[4] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #5 set to ON");
-				Switch5SP.s = IPS_OK;
-				Switch5S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch5SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch5S[1].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay5, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #5");
-					Switch5SP.s = IPS_ALERT;
-					Switch5S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch5SP, NULL);
-					return false;
-				}
-				relayState[4] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #5 set to OFF");
-				Switch5SP.s = IPS_IDLE;
-				Switch5S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch5SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
+			DEBUGF(INDI::Logger::DBG_SESSION, "Astroberry Relays #%d set to %s", relay + 1, on ? "ON" : "OFF");
+			setRelaySwitch(relay, on);
+			updateGroupSwitches();
+			return true;
 		}
 
-		// handle relay 6
-		if (!strcmp(name, Switch6SP.name))
+		// handle relay groups
+		for (int group = 0; group < groupCount; group++)
 		{
-			IUUpdateSwitch(&Switch6SP, states, names, n);
+			ISwitchVectorProperty *svp = &groups[group].SwitchSP;
+			if (strcmp(name, svp->name))
+				continue;
 
-			if ( Switch6S[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay6, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #6");
-					Switch6SP.s = IPS_ALERT;
-					Switch6S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch6SP, NULL);
-					return false;
-				}
-				relayState[5] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #6 set to ON");
-				Switch6SP.s = IPS_OK;
-				Switch6S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch6SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch6S[1].s == ISS_ON )
+			// command is the element set ON, a partial group shows neither so the previous state says nothing
+			ISwitch *sp = nullptr;
+			for (int i = 0; i < n && !sp; i++)
 			{
-				rv = gpiod_line_set_value(gpio_relay6, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #6");
-					Switch6SP.s = IPS_ALERT;
-					Switch6S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch6SP, NULL);
-					return false;
-				}
-				relayState[5] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #6 set to OFF");
-				Switch6SP.s = IPS_IDLE;
-				Switch6S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch6SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
+				if (states[i] == ISS_ON)
+					sp = IUFindSwitch(svp, names[i]);
 			}
-		}
-
-		// handle relay 7
-		if (!strcmp(name, Switch7SP.name))
-		{
-			IUUpdateSwitch(&Switch7SP, states, names, n);
-
-			if ( Switch7S[0].s == ISS_ON )
+			if (!sp)
 			{
-				rv = gpiod_line_set_value(gpio_relay7, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #7");
-					Switch7SP.s = IPS_ALERT;
-					Switch7S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch7SP, NULL);
-					return false;
-				}
-				relayState[6] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #7 set to ON");
-				Switch7SP.s = IPS_OK;
-				Switch7S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch7SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
+				updateGroupSwitches(group);
 				return true;
 			}
-			if ( Switch7S[1].s == ISS_ON )
+			bool on = sp == &groups[group].SwitchS[0];
+			uint64_t mask = on ? relayState | groups[group].mask : relayState & ~groups[group].mask;
+
+			// all relays of group in a single write
+			uint64_t previous = relayState;
+			int rv = writeRelays(mask);
+			uint64_t changed = previous ^ relayState;
+			for (int relay = 0; changed; relay++, changed >>= 1)
 			{
-				rv = gpiod_line_set_value(gpio_relay7, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #7");
-					Switch7SP.s = IPS_ALERT;
-					Switch7S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch7SP, NULL);
-					return false;
-				}
-				relayState[6] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #7 set to OFF");
-				Switch7SP.s = IPS_IDLE;
-				Switch7S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch7SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
+				if (changed & 1)
+					setRelaySwitch(relay, relayState >> relay & 1);
 			}
-		}
 
-		// handle relay 8
-		if (!strcmp(name, Switch8SP.name))
-		{
-			IUUpdateSwitch(&Switch8SP, states, names, n);
-
-			if ( Switch8S[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay8, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #8");
-					Switch8SP.s = IPS_ALERT;
-					Switch8S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch8SP, NULL);
-					return false;
-				}
-				relayState[7] =  activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #8 set to ON");
-				Switch8SP.s = IPS_OK;
-				Switch8S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch8SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( Switch8S[1].s == ISS_ON )
+			if (rv != 0)
 			{
-				rv = gpiod_line_set_value(gpio_relay8, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #8");
-					Switch8SP.s = IPS_ALERT;
-					Switch8S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch8SP, NULL);
-					return false;
-				}
-				relayState[7] =  !activeState;
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #8 set to OFF");
-				Switch8SP.s = IPS_IDLE;
-				Switch8S[0].s = ISS_OFF;
-				IDSetSwitch(&Switch8SP, NULL);
-				//IUResetSwitch(&MasterSwitchSP);
-				//IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
+				DEBUGF(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relays group %s", groups[group].label);
+				updateGroupSwitches();
+				svp->s = IPS_ALERT;
+				IDSetSwitch(svp, NULL);
+				return false;
 			}
-		}
-
-		/*
-		// handle master switch
-		if (!strcmp(name, MasterSwitchSP.name))
-		{
-			IUUpdateSwitch(&MasterSwitchSP, states, names, n);
 
-			if ( MasterSwitchS[0].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay1, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #1");
-					Switch1SP.s = IPS_ALERT;
-					Switch1S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch1SP, NULL);
-					return false;
-				}
-				relayState[0] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #1 set to ON");
-				Switch1SP.s = IPS_OK;
-				Switch1S[0].s = ISS_ON;
-				Switch1S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch1SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay2, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #2");
-					Switch2SP.s = IPS_ALERT;
-					Switch2S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch2SP, NULL);
-					return false;
-				}
-				relayState[1] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #2 set to ON");
-				Switch2SP.s = IPS_OK;
-				Switch2S[0].s = ISS_ON;
-				Switch2S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch2SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay3, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #3");
-					Switch3SP.s = IPS_ALERT;
-					Switch3S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch3SP, NULL);
-					return false;
-				}
-				relayState[2] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #3 set to ON");
-				Switch3SP.s = IPS_OK;
-				Switch3S[0].s = ISS_ON;
-				Switch3S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch3SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay4, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #4");
-					Switch4SP.s = IPS_ALERT;
-					Switch4S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch4SP, NULL);
-					return false;
-				}
-				relayState[3] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #4 set to ON");
-				Switch4SP.s = IPS_OK;
-				Switch4S[0].s = ISS_ON;
-				Switch4S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch4SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay5, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #5");
-					Switch5SP.s = IPS_ALERT;
-					Switch5S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch5SP, NULL);
-					return false;
-				}
-				relayState[4] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #5 set to ON");
-				Switch5SP.s = IPS_OK;
-				Switch5S[0].s = ISS_ON;
-				Switch5S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch5SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay6, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #6");
-					Switch6SP.s = IPS_ALERT;
-					Switch6S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch6SP, NULL);
-					return false;
-				}
-				relayState[5] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #6 set to ON");
-				Switch6SP.s = IPS_OK;
-				Switch6S[0].s = ISS_ON;
-				Switch6S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch6SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay7, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #7");
-					Switch7SP.s = IPS_ALERT;
-					Switch7S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch7SP, NULL);
-					return false;
-				}
-				relayState[6] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #7 set to ON");
-				Switch7SP.s = IPS_OK;
-				Switch7S[0].s = ISS_ON;
-				Switch7S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch7SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay8, activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #8");
-					Switch8SP.s = IPS_ALERT;
-					Switch8S[0].s = ISS_OFF;
-					IDSetSwitch(&Switch8SP, NULL);
-					return false;
-				}
-				relayState[7] =  activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #8 set to ON");
-				Switch8SP.s = IPS_OK;
-				Switch8S[0].s = ISS_ON;
-				Switch8S[1].s = ISS_OFF;
-				IDSetSwitch(&Switch8SP, NULL);
-
-				// master switch
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays all set to ON");
-				MasterSwitchSP.s = IPS_OK;
-				MasterSwitchS[1].s = ISS_OFF;
-				IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
-			if ( MasterSwitchS[1].s == ISS_ON )
-			{
-				rv = gpiod_line_set_value(gpio_relay1, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #1");
-					Switch1SP.s = IPS_ALERT;
-					Switch1S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch1SP, NULL);
-					return false;
-				}
-				relayState[0] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #1 set to OFF");
-				Switch1SP.s = IPS_IDLE;
-				Switch1S[0].s = ISS_OFF;
-				Switch1S[1].s = ISS_ON;
-				IDSetSwitch(&Switch1SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay2, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #2");
-					Switch2SP.s = IPS_ALERT;
-					Switch2S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch2SP, NULL);
-					return false;
-				}
-				relayState[1] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #2 set to OFF");
-				Switch2SP.s = IPS_IDLE;
-				Switch2S[0].s = ISS_OFF;
-				Switch2S[1].s = ISS_ON;
-				IDSetSwitch(&Switch2SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay3, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #3");
-					Switch3SP.s = IPS_ALERT;
-					Switch3S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch3SP, NULL);
-					return false;
-				}
-				relayState[2] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #3 set to OFF");
-				Switch3SP.s = IPS_IDLE;
-				Switch3S[0].s = ISS_OFF;
-				Switch3S[1].s = ISS_ON;
-				IDSetSwitch(&Switch3SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay4, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #4");
-					Switch4SP.s = IPS_ALERT;
-					Switch4S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch4SP, NULL);
-					return false;
-				}
-				relayState[3] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #4 set to OFF");
-				Switch4SP.s = IPS_IDLE;
-				Switch4S[0].s = ISS_OFF;
-				Switch4S[1].s = ISS_ON;
-				IDSetSwitch(&Switch4SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay5, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #5");
-					Switch5SP.s = IPS_ALERT;
-					Switch5S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch5SP, NULL);
-					return false;
-				}
-				relayState[4] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #5 set to OFF");
-				Switch5SP.s = IPS_IDLE;
-				Switch5S[0].s = ISS_OFF;
-				Switch5S[1].s = ISS_ON;
-				IDSetSwitch(&Switch5SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay6, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #6");
-					Switch6SP.s = IPS_ALERT;
-					Switch6S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch6SP, NULL);
-					return false;
-				}
-				relayState[5] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #6 set to OFF");
-				Switch6SP.s = IPS_IDLE;
-				Switch6S[0].s = ISS_OFF;
-				Switch6S[1].s = ISS_ON;
-				IDSetSwitch(&Switch6SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay7, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #7");
-					Switch7SP.s = IPS_ALERT;
-					Switch7S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch7SP, NULL);
-					return false;
-				}
-				relayState[6] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #7 set to OFF");
-				Switch7SP.s = IPS_IDLE;
-				Switch7S[0].s = ISS_OFF;
-				Switch7S[1].s = ISS_ON;
-				IDSetSwitch(&Switch7SP, NULL);
-
-				rv = gpiod_line_set_value(gpio_relay8, !activeState);
-				if (rv != 0)
-				{
-					DEBUG(INDI::Logger::DBG_ERROR, "Error setting Astroberry Relay #8");
-					Switch8SP.s = IPS_ALERT;
-					Switch8S[1].s = ISS_OFF;
-					IDSetSwitch(&Switch8SP, NULL);
-					return false;
-				}
-				relayState[7] =  !activeState;
-				//DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays #8 set to OFF");
-				Switch8SP.s = IPS_IDLE;
-				Switch8S[0].s = ISS_OFF;
-				Switch8S[1].s = ISS_ON;
-				IDSetSwitch(&Switch8SP, NULL);
-
-				// master switch
-				DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays set all to OFF");
-				MasterSwitchSP.s = IPS_IDLE;
-				MasterSwitchS[0].s = ISS_OFF;
-				IDSetSwitch(&MasterSwitchSP, NULL);
-				return true;
-			}
+			DEBUGF(INDI::Logger::DBG_SESSION, "Astroberry Relays group %s set to %s", groups[group].label, on ? "ON" : "OFF");
+			updateGroupSwitches(group);
+			return true;
 		}
-		*/
 	}
 	return INDI::DefaultDevice::ISNewSwitch (dev, name, states, names, n);
 }
@@ -1095,7 +592,27 @@ bool IndiAstroberryRelays::ISNewText (const char *dev, const char *name, char *t
 			RelayLabelsTP.s=IPS_OK;
 			IDSetText(&RelayLabelsTP, nullptr);
 			DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays labels set . You need to save configuration and restart driver to activate the changes.");
-			DEBUGF(INDI::Logger::DBG_DEBUG, "Astroberry Relays labels set to Relay1: %s, Relay2: %s, Relay3: %s, Relay4: %s, Relay5: %s, Relay6: %s, Relay7: %s, Relay8: %s", RelayLabelsT[0].text, RelayLabelsT[1].text, RelayLabelsT[2].text, RelayLabelsT[3].text, RelayLabelsT[4].text, RelayLabelsT[5].text, RelayLabelsT[6].text, RelayLabelsT[7].text);
+			for (int relay = 0; relay < relayCount; relay++)
+				DEBUGF(INDI::Logger::DBG_DEBUG, "Relay%d: %s", relay + 1, RelayLabelsT[relay].text);
+
+			return true;
+		}
+
+		// handle relay groups
+		if (!strcmp(name, RelayGroupsTP.name))
+		{
+			if (isConnected())
+			{
+				DEBUG(INDI::Logger::DBG_WARNING, "Cannot set groups while device is connected.");
+				return false;
+			}
+
+			IUUpdateText(&RelayGroupsTP, texts, names, n);
+			RelayGroupsTP.s=IPS_OK;
+			IDSetText(&RelayGroupsTP, nullptr);
+			DEBUG(INDI::Logger::DBG_SESSION, "Astroberry Relays groups set");
+			for (int group = 0; group < MAX_RELAY_GROUPS; group++)
+				DEBUGF(INDI::Logger::DBG_DEBUG, "Group%d: %s", group + 1, RelayGroupsT[group].text);
 
 			return true;
 		}
@@ -1113,191 +630,252 @@ bool IndiAstroberryRelays::ISSnoopDevice(XMLEle *root)
 }
 bool IndiAstroberryRelays::saveConfigItems(FILE *fp)
 {
+	// relay count first, so options are sized before they are loaded
+	IUSaveConfigNumber(fp, &RelayCountNP);
+	IUSaveConfigNumber(fp, &PollingNP);
+	IUSaveConfigNumber(fp, &GPIOChipsNP);
 	IUSaveConfigNumber(fp, &BCMpinsNP);
 	IUSaveConfigText(fp, &RelayLabelsTP);
+	IUSaveConfigText(fp, &RelayGroupsTP);
 	IUSaveConfigSwitch(fp, &ActiveStateSP);
-	IUSaveConfigSwitch(fp, &Switch1SP);
-	IUSaveConfigSwitch(fp, &Switch2SP);
-	IUSaveConfigSwitch(fp, &Switch3SP);
-	IUSaveConfigSwitch(fp, &Switch4SP);
-	IUSaveConfigSwitch(fp, &Switch5SP);
-	IUSaveConfigSwitch(fp, &Switch6SP);
-	IUSaveConfigSwitch(fp, &Switch7SP);
-	IUSaveConfigSwitch(fp, &Switch8SP);
+	for (int relay = 0; relay < relayCount; relay++)
+		IUSaveConfigSwitch(fp, &relays[relay].SwitchSP);
 
 	return true;
 }
 
 void IndiAstroberryRelays::TimerHit()
 {
+	pollingTimerID = -1;
+
 	if(isConnected())
 	{
 		udateSwitches();
-		SetTimer(pollingTime);
+		if (PollingN[0].value > 0)
+			pollingTimerID = SetTimer(PollingN[0].value * 1000);
 	}
 }
 
 void IndiAstroberryRelays::udateSwitches()
 {
-	int gpio_relay_status[8];
-	
-	gpio_relay_status[0] = gpiod_line_get_value(gpio_relay1);
-	gpio_relay_status[1] = gpiod_line_get_value(gpio_relay2);
-	gpio_relay_status[2] = gpiod_line_get_value(gpio_relay3);
-	gpio_relay_status[3] = gpiod_line_get_value(gpio_relay4);
-	gpio_relay_status[4] = gpiod_line_get_value(gpio_relay5);
-	gpio_relay_status[5] = gpiod_line_get_value(gpio_relay6);
-	gpio_relay_status[6] = gpiod_line_get_value(gpio_relay7);
-	gpio_relay_status[7] = gpiod_line_get_value(gpio_relay8);
-
-	// handle active-low status
-	for (int i=0; i < 8; i++) {
-		if (activeState == 0)
-			gpio_relay_status[i] = !gpio_relay_status[i];
+	uint64_t mask;
+
+	if (readRelays(mask) != 0)
+	{
+		DEBUG(INDI::Logger::DBG_ERROR, "Error reading Astroberry Relays status");
+		return;
 	}
 
-	// update relay switch #1
-	if ( Switch1S[0].s != gpio_relay_status[0])
+	// update only relays changed outside of the driver
+	uint64_t changed = mask ^ relayState;
+	relayState = mask;
+	for (int relay = 0; changed; relay++, changed >>= 1)
 	{
-		if (gpio_relay_status[0] == 1)
-		{
-			Switch1SP.s = IPS_OK;
-			Switch1S[0].s = ISS_ON;
-			Switch1S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch1SP, NULL);
-		} else {
-			Switch1SP.s = IPS_IDLE;
-			Switch1S[0].s = ISS_OFF;
-			Switch1S[1].s = ISS_ON;
-			IDSetSwitch(&Switch1SP, NULL);
-		}
+		if (changed & 1)
+			setRelaySwitch(relay, mask >> relay & 1);
 	}
+	updateGroupSwitches();
+
+	DEBUGF(INDI::Logger::DBG_DEBUG, "Relays status: 0x%llx", (unsigned long long) mask);
+}
 
-	// update relay switch #2
-	if ( Switch2S[0].s != gpio_relay_status[1])
+void IndiAstroberryRelays::fillRelayGroups()
+{
+	groupCount = 0;
+	for (int i = 0; i < MAX_RELAY_GROUPS; i++)
 	{
-		if (gpio_relay_status[1] == 1)
+		// "name: relay, relay, ..."
+		const char *text = RelayGroupsT[i].text;
+		const char *colon = strchr(text, ':');
+		if (!colon || colon == text)
+			continue;
+
+		RelayGroup &group = groups[groupCount];
+		snprintf(group.label, MAXINDILABEL, "%.*s", (int) (colon - text), text);
+		group.mask = 0;
+		for (const char *p = colon + 1; *p; )
 		{
-			Switch2SP.s = IPS_OK;
-			Switch2S[0].s = ISS_ON;
-			Switch2S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch2SP, NULL);
-		} else {
-			Switch2SP.s = IPS_IDLE;
-			Switch2S[0].s = ISS_OFF;
-			Switch2S[1].s = ISS_ON;
-			IDSetSwitch(&Switch2SP, NULL);
+			char *end;
+			long relay = strtol(p, &end, 10);
+			if (end == p)
+			{
+				p++;
+				continue;
+			}
+			if (relay >= 1 && relay <= relayCount)
+				group.mask |= 1ULL << (relay - 1);
+			else
+				DEBUGF(INDI::Logger::DBG_WARNING, "Relay %ld of group %s does not exist", relay, group.label);
+			p = end;
 		}
+		if (!group.mask)
+			continue;
+
+		char name[MAXINDINAME];
+		snprintf(name, MAXINDINAME, "GROUP%dON", i + 1);
+		IUFillSwitch(&group.SwitchS[0], name, "ON", ISS_OFF);
+		snprintf(name, MAXINDINAME, "GROUP%dOFF", i + 1);
+		IUFillSwitch(&group.SwitchS[1], name, "OFF", ISS_OFF);
+		snprintf(name, MAXINDINAME, "GROUP_%d", i + 1);
+		IUFillSwitchVector(&group.SwitchSP, group.SwitchS, 2, getDeviceName(), name, group.label, MAIN_CONTROL_TAB, IP_RW, ISR_ATMOST1, 0, IPS_IDLE);
+		groupCount++;
 	}
+}
 
-	// update relay switch #3
-	if ( Switch3S[0].s != gpio_relay_status[2])
+void IndiAstroberryRelays::updateGroupSwitches(int commanded)
+{
+	// group is ON when all its relays are ON, OFF when all are OFF, neither otherwise
+	for (int group = 0; group < groupCount; group++)
 	{
-		if (gpio_relay_status[2] == 1)
-		{
-			Switch3SP.s = IPS_OK;
-			Switch3S[0].s = ISS_ON;
-			Switch3S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch3SP, NULL);
-		} else {
-			Switch3SP.s = IPS_IDLE;
-			Switch3S[0].s = ISS_OFF;
-			Switch3S[1].s = ISS_ON;
-			IDSetSwitch(&Switch3SP, NULL);
-		}
+		uint64_t on = relayState & groups[group].mask;
+		ISState onState = on == groups[group].mask ? ISS_ON : ISS_OFF;
+		ISState offState = on == 0 ? ISS_ON : ISS_OFF;
+		IPState state = onState == ISS_ON ? IPS_OK : IPS_IDLE;
+
+		if (group != commanded && groups[group].SwitchS[0].s == onState && groups[group].SwitchS[1].s == offState && groups[group].SwitchSP.s == state)
+			continue;
+
+		groups[group].SwitchS[0].s = onState;
+		groups[group].SwitchS[1].s = offState;
+		groups[group].SwitchSP.s = state;
+		IDSetSwitch(&groups[group].SwitchSP, NULL);
 	}
+}
 
-	// update relay switch #4
-	if ( Switch4S[0].s != gpio_relay_status[3])
+void IndiAstroberryRelays::setRelaySwitch(int relay, bool on)
+{
+	relays[relay].SwitchSP.s = on ? IPS_OK : IPS_IDLE;
+	relays[relay].SwitchS[0].s = on ? ISS_ON : ISS_OFF;
+	relays[relay].SwitchS[1].s = on ? ISS_OFF : ISS_ON;
+	IDSetSwitch(&relays[relay].SwitchSP, NULL);
+}
+
+void IndiAstroberryRelays::closeRelayChips()
+{
+	// stop watching before lines are released, closing a chip releases its requested lines
+	for (auto &relayChip : relayChips)
 	{
-		if (gpio_relay_status[3] == 1)
+		if (relayChip.watchFD != -1)
 		{
-			Switch4SP.s = IPS_OK;
-			Switch4S[0].s = ISS_ON;
-			Switch4S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch4SP, NULL);
-		} else {
-			Switch4SP.s = IPS_IDLE;
-			Switch4S[0].s = ISS_OFF;
-			Switch4S[1].s = ISS_ON;
-			IDSetSwitch(&Switch4SP, NULL);
+			IERmCallback(relayChip.watchID);
+			close(relayChip.watchFD);
 		}
+		gpiod_chip_close(relayChip.chip);
 	}
+	relayChips.clear();
+}
+
+void IndiAstroberryRelays::watchRelayChip(RelayChip &relayChip)
+{
+#ifdef GPIO_GET_LINEINFO_WATCH_IOCTL
+	// separate chip descriptor for line info events
+	char path[64];
+	snprintf(path, sizeof(path), "/dev/%s", gpiod_chip_name(relayChip.chip));
+	int fd = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+	if (fd == -1)
+		return;
 
-	// update relay switch #5
-	if ( Switch5S[0].s != gpio_relay_status[4])
+	unsigned int count = gpiod_line_bulk_num_lines(&relayChip.lines);
+	for (unsigned int i = 0; i < count; i++)
 	{
-		if (gpio_relay_status[4] == 1)
+		struct gpioline_info info;
+		memset(&info, 0, sizeof(info));
+		info.line_offset = gpiod_line_offset(gpiod_line_bulk_get_line(&relayChip.lines, i));
+		if (ioctl(fd, GPIO_GET_LINEINFO_WATCH_IOCTL, &info) == -1)
 		{
-			Switch5SP.s = IPS_OK;
-			Switch5S[0].s = ISS_ON;
-			Switch5S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch5SP, NULL);
-		} else {
-			Switch5SP.s = IPS_IDLE;
-			Switch5S[0].s = ISS_OFF;
-			Switch5S[1].s = ISS_ON;
-			IDSetSwitch(&Switch5SP, NULL);
+			DEBUGF(INDI::Logger::DBG_DEBUG, "Line info watch not supported by %s, relying on status check", gpiod_chip_name(relayChip.chip));
+			close(fd);
+			return;
 		}
 	}
 
-	// update relay switch #6
-	if ( Switch6S[0].s != gpio_relay_status[5])
+	relayChip.watchFD = fd;
+	relayChip.watchID = IEAddCallback(fd, relayWatchHelper, this);
+#else
+	INDI_UNUSED(relayChip);
+#endif
+}
+
+void IndiAstroberryRelays::relayWatchHelper(int fd, void *context)
+{
+	static_cast<IndiAstroberryRelays*>(context)->relayWatchEvent(fd);
+}
+
+void IndiAstroberryRelays::relayWatchEvent(int fd)
+{
+#ifdef GPIO_GET_LINEINFO_WATCH_IOCTL
+	struct gpioline_info_changed event;
+	ssize_t rv;
+	while ((rv = read(fd, &event, sizeof(event))) == sizeof(event))
 	{
-		if (gpio_relay_status[5] == 1)
-		{
-			Switch6SP.s = IPS_OK;
-			Switch6S[0].s = ISS_ON;
-			Switch6S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch6SP, NULL);
-		} else {
-			Switch6SP.s = IPS_IDLE;
-			Switch6S[0].s = ISS_OFF;
-			Switch6S[1].s = ISS_ON;
-			IDSetSwitch(&Switch6SP, NULL);
-		}
+		const char *change = event.event_type == GPIOLINE_CHANGED_REQUESTED ? "requested" :
+			event.event_type == GPIOLINE_CHANGED_RELEASED ? "released" : "reconfigured";
+		DEBUGF(INDI::Logger::DBG_WARNING, "GPIO line %u %s by %s", event.info.line_offset, change, event.info.consumer[0] ? event.info.consumer : "other consumer");
 	}
 
-	// update relay switch #7
-	if ( Switch7S[0].s != gpio_relay_status[6])
+	// chip gone, e.g. unplugged expander
+	if (rv == 0 || (rv == -1 && errno != EAGAIN))
 	{
-		if (gpio_relay_status[6] == 1)
+		for (auto &relayChip : relayChips)
 		{
-			Switch7SP.s = IPS_OK;
-			Switch7S[0].s = ISS_ON;
-			Switch7S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch7SP, NULL);
-		} else {
-			Switch7SP.s = IPS_IDLE;
-			Switch7S[0].s = ISS_OFF;
-			Switch7S[1].s = ISS_ON;
-			IDSetSwitch(&Switch7SP, NULL);
+			if (relayChip.watchFD != fd)
+				continue;
+			DEBUGF(INDI::Logger::DBG_ERROR, "Lost line info watch of %s", gpiod_chip_name(relayChip.chip));
+			IERmCallback(relayChip.watchID);
+			close(relayChip.watchFD);
+			relayChip.watchFD = -1;
+			relayChip.watchID = -1;
 		}
 	}
+#endif
+
+	// check relays status at once
+	udateSwitches();
+}
+
+int IndiAstroberryRelays::readRelays(uint64_t &mask)
+{
+	mask = 0;
 
-	// update relay switch #8
-	if ( Switch8S[0].s != gpio_relay_status[7])
+	// one bulk read per chip
+	for (auto &relayChip : relayChips)
 	{
-		if (gpio_relay_status[7] == 1)
+		int values[MAX_RELAYS];
+		int rv = gpiod_line_get_value_bulk(&relayChip.lines, values);
+		if (rv != 0)
+			return rv;
+
+		// handle active-low status
+		unsigned int count = gpiod_line_bulk_num_lines(&relayChip.lines);
+		for (unsigned int i = 0; i < count; i++)
 		{
-			Switch8SP.s = IPS_OK;
-			Switch8S[0].s = ISS_ON;
-			Switch8S[1].s = ISS_OFF;
-			IDSetSwitch(&Switch8SP, NULL);
-		} else {
-			Switch8SP.s = IPS_IDLE;
-			Switch8S[0].s = ISS_OFF;
-			Switch8S[1].s = ISS_ON;
-			IDSetSwitch(&Switch8SP, NULL);
+			if (values[i] == activeState)
+				mask |= 1ULL << relayChip.relays[i];
 		}
 	}
+	return 0;
+}
+
+int IndiAstroberryRelays::writeRelays(uint64_t mask)
+{
+	uint64_t changed = mask ^ relayState;
 
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #1 status: %i - Switch #1 status: %i", gpio_relay_status[0], Switch1S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #2 status: %i - Switch #1 status: %i", gpio_relay_status[1], Switch2S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #3 status: %i - Switch #1 status: %i", gpio_relay_status[2], Switch3S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #4 status: %i - Switch #1 status: %i", gpio_relay_status[3], Switch4S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #5 status: %i - Switch #1 status: %i", gpio_relay_status[4], Switch5S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #6 status: %i - Switch #1 status: %i", gpio_relay_status[5], Switch6S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #7 status: %i - Switch #1 status: %i", gpio_relay_status[6], Switch7S[0].s);
-	DEBUGF(INDI::Logger::DBG_DEBUG, "Relay #8 status: %i - Switch #1 status: %i", gpio_relay_status[7], Switch8S[0].s);
+	// one bulk write per chip with changed relays
+	for (auto &relayChip : relayChips)
+	{
+		if (!(changed & relayChip.mask))
+			continue;
+
+		int values[MAX_RELAYS];
+		unsigned int count = gpiod_line_bulk_num_lines(&relayChip.lines);
+		for (unsigned int i = 0; i < count; i++)
+			values[i] = mask >> relayChip.relays[i] & 1 ? activeState : !activeState;
+
+		// lines share one request, so the whole chip is written with a single ioctl
+		int rv = gpiod_line_set_value_bulk(&relayChip.lines, values);
+		if (rv != 0)
+			return rv;
+		relayState = (relayState & ~relayChip.mask) | (mask & relayChip.mask);
+	}
+	return 0;
 }
@@ -22,8 +22,16 @@
 #include <string.h>
 #include <iostream>
 #include <stdio.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
 
 #include <defaultdevice.h>
+#include <gpiod.h>
+
+#define MAX_RELAYS 64 // relay state is kept in 64 bit masks, also the limit of lines in one GPIO request
+#define MAX_RELAY_GROUPS 8
 
 class IndiAstroberryRelays : public INDI::DefaultDevice
 {
@@ -46,50 +54,68 @@ private:
 	virtual bool Connect();
 	virtual bool Disconnect();
 	virtual void udateSwitches();
+	void fillRelayOptions();
+	void closeRelayChips();
+	struct RelayChip;
+	void watchRelayChip(RelayChip &relayChip);
+	void relayWatchEvent(int fd);
+	static void relayWatchHelper(int fd, void *context);
+	void setRelaySwitch(int relay, bool on);
+	void fillRelayGroups();
+	void updateGroupSwitches(int commanded = -1);
+	int readRelays(uint64_t &mask);
+	int writeRelays(uint64_t mask);
 
-	INumber BCMpinsN[8];
+	INumber RelayCountN[1];
+	INumberVectorProperty RelayCountNP;
+	INumber PollingN[1];
+	INumberVectorProperty PollingNP;
+	INumber GPIOChipsN[MAX_RELAYS];
+	INumberVectorProperty GPIOChipsNP;
+	INumber BCMpinsN[MAX_RELAYS];
 	INumberVectorProperty BCMpinsNP;
 	ISwitch ActiveStateS[2];
 	ISwitchVectorProperty ActiveStateSP;
-	IText RelayLabelsT[8];
+	IText RelayLabelsT[MAX_RELAYS];
 	ITextVectorProperty RelayLabelsTP;
+	IText RelayGroupsT[MAX_RELAY_GROUPS];
+	ITextVectorProperty RelayGroupsTP;
 
-	ISwitch Switch1S[2];
-	ISwitchVectorProperty Switch1SP;
-	ISwitch Switch2S[2];
-	ISwitchVectorProperty Switch2SP;
-	ISwitch Switch3S[2];
-	ISwitchVectorProperty Switch3SP;
-	ISwitch Switch4S[2];
-	ISwitchVectorProperty Switch4SP;
-	ISwitch Switch5S[2];
-	ISwitchVectorProperty Switch5SP;
-	ISwitch Switch6S[2];
-	ISwitchVectorProperty Switch6SP;
-	ISwitch Switch7S[2];
-	ISwitchVectorProperty Switch7SP;
-	ISwitch Switch8S[2];
-	ISwitchVectorProperty Switch8SP;
-	//ISwitch MasterSwitchS[2];
-	//ISwitchVectorProperty MasterSwitchSP;
+	// relay channel table
+	struct RelayChannel
+	{
+		ISwitch SwitchS[2];
+		ISwitchVectorProperty SwitchSP;
+	};
+	RelayChannel relays[MAX_RELAYS];
+	int relayCount = 8;
 
-	//ILight SwitchStatusL[8];
-	//ILightVectorProperty SwitchStatusLP;
+	// relay groups switched with one write
+	struct RelayGroup
+	{
+		ISwitch SwitchS[2];
+		ISwitchVectorProperty SwitchSP;
+		char label[MAXINDILABEL];
+		uint64_t mask; // relays in group
+	};
+	RelayGroup groups[MAX_RELAY_GROUPS];
+	int groupCount = 0;
 
 	int activeState = 0;
-	int relayState[8]; // relayState is mission critical to maintain relays status between reconnections. initially set to !activeState
-	int pollingTime = 1000;
+	uint64_t relayState = 0; // relays switched ON, mission critical to maintain relays status between reconnections
+	int pollingTimerID = -1; // consistency check of relays status
 
-	const char* gpio_chip_path = "/dev/gpiochip0";
-	struct gpiod_chip *chip;
-	struct gpiod_line *gpio_relay1;
-	struct gpiod_line *gpio_relay2;
-	struct gpiod_line *gpio_relay3;
-	struct gpiod_line *gpio_relay4;
-	struct gpiod_line *gpio_relay5;
-	struct gpiod_line *gpio_relay6;
-	struct gpiod_line *gpio_relay7;
-	struct gpiod_line *gpio_relay8;
+	// relays grouped by gpiochip, each chip is read and written with one bulk request
+	struct RelayChip
+	{
+		struct gpiod_chip *chip;
+		struct gpiod_line_bulk lines;
+		int relays[MAX_RELAYS]; // relay of each line in bulk request
+		uint64_t mask; // relays on this chip
+		int watchFD; // line info changes of relay lines
+		int watchID;
+	};
+	std::vector<RelayChip> relayChips;
 };
 
 #endif